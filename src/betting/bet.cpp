@@ -12,11 +12,14 @@
 #endif
 
 #include "bet.h"
+#include "betting/drawresults.h"
 #include "core_io.h"
 #include <ctime>
 
-#include "wallet/wallet.h"
+#include "guiinterface.h"
 #include "spork.h"
+#include "txdb.h"
+#include "wallet/wallet.h"
 
 #define BTX_FORMAT_VERSION 0x01
 #define BTX_HEX_PREFIX "42"
@@ -298,6 +301,40 @@ bool CLottoBet::FromOpCode(std::string opCode, CLottoBet &lb)
     return true;
 }
 
+/**
+ * Decode a CLottoBet from an output script without going through its asm form.
+ * Bets are placed as OP_RETURN followed by a single push of the op code, which is
+ * decoded in place. Any other OP_RETURN script is decoded from its asm form like
+ * before, so that both paths accept exactly the same scripts.
+ *
+ * @param script The output script
+ * @param lb     The CLottoBet object
+ * @return       Bool
+ */
+bool CLottoBet::FromScript(const CScript& script, CLottoBet &lb)
+{
+    if (script.empty() || script[0] != OP_RETURN)
+        return false;
+
+    if (script.size() == 2 + LB_OP_STRLEN / 2 && script[1] == LB_OP_STRLEN / 2) {
+        const unsigned char* opCode = script.data() + 2;
+        if (opCode[0] != 'B' || opCode[1] != BTX_FORMAT_VERSION || opCode[2] != plBetTxType)
+            return false;
+
+        lb.nDate = FromChars(opCode[3], opCode[4], opCode[5], opCode[6]);
+        lb.nNumber1 = FromChars(opCode[7], opCode[8]);
+        lb.nNumber2 = FromChars(opCode[9], opCode[10]);
+        lb.nNumber3 = FromChars(opCode[11], opCode[12]);
+        return true;
+    }
+
+    std::string scriptPubKey = ScriptToAsmStr(script);
+    std::vector<unsigned char> vOpCode = ParseHex(scriptPubKey.substr(9, std::string::npos));
+    std::string opCode(vOpCode.begin(), vOpCode.end());
+
+    return FromOpCode(opCode, lb);
+}
+
 /**
  * Convert CLottoBet object data into hex OPCode string.
  *
@@ -323,12 +360,99 @@ bool CLottoBet::ToOpCode(CLottoBet lb, std::string &opCode)
     return true;
 }
 
+CBetPayoutCache betPayoutCache;
+
+bool CBetPayoutCache::Get(const uint256& hashTip, const uint256& hashInputs, std::vector<CBetOut>& vPayouts) const
+{
+    LOCK(cs);
+    for (const Entry& entry : entries) {
+        if (entry.hashTip == hashTip && entry.hashInputs == hashInputs) {
+            vPayouts = entry.vPayouts;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CBetPayoutCache::Put(const uint256& hashTip, const uint256& hashInputs, const std::vector<CBetOut>& vPayouts)
+{
+    LOCK(cs);
+    for (Entry& entry : entries) {
+        if (entry.hashTip == hashTip && entry.hashInputs == hashInputs) {
+            entry.vPayouts = vPayouts;
+            return;
+        }
+    }
+    if (entries.size() >= MAX_ENTRIES)
+        entries.pop_front();
+    entries.push_back(Entry{hashTip, hashInputs, vPayouts});
+}
+
+void CBetPayoutCache::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+}
+
+void CBetPayoutCache::BlockDisconnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    const uint256& hashBlock = pindex->GetBlockHash();
+    LOCK(cs);
+    for (std::deque<Entry>::iterator it = entries.begin(); it != entries.end();) {
+        if (it->hashTip == hashBlock)
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+uint32_t GetPaidDrawDate(std::time_t nTipTime)
+{
+    // The draw took place the evening before the last draw time, which is in UTC.
+    std::time_t nDrawTime = lastdrawtime(nTipTime) - 60*60*24;
+    std::tm* ptm = std::gmtime(&nDrawTime);
+    return (ptm->tm_year + 1900) * 10000 + (ptm->tm_mon + 1) * 100 + ptm->tm_mday;
+}
+
+bool IsBetPayoutHeight(int height, std::time_t nTipTime)
+{
+    return height % 1500 == 0 && nTipTime > lastdrawtime(nTipTime) + (height <= 88500 ? 60*60*16 : 60*60*18);
+}
+
+CAmount GetLottoBetPayout(const CLottoBet& lb, CAmount nBetValue)
+{
+    double nOneNumberOdds = 12;
+    double nTwoNumberOdds = 200;
+    double nThreeNumberOdds = 3500;
+
+    if (lb.nNumber3 > 0 && lb.nNumber2 > 0 && lb.nNumber1 > 0) {
+        return nBetValue * nThreeNumberOdds;
+    }
+    else if ((lb.nNumber1 > 0 && lb.nNumber2 > 0)||(lb.nNumber1 > 0 && lb.nNumber3 > 0)||(lb.nNumber2 > 0 && lb.nNumber3 > 0)) {
+        return nBetValue * nTwoNumberOdds;
+    }
+    else if (lb.nNumber1 > 0 || lb.nNumber2 > 0 || lb.nNumber3 > 0) {
+        return nBetValue * nOneNumberOdds;
+    }
+    return 0;
+}
+
 /**
  * Creates the bet payout vector for all winning CLottoBet bets.
  *
  * @return payout vector.
  */
 std::vector<CBetOut> GetBetPayouts(int height)
+{
+    return GetBetPayouts(height, *drawResultOracle.GetSnapshot());
+}
+
+/**
+ * Creates the bet payout vector for all winning CLottoBet bets, using the given draw results.
+ *
+ * @return payout vector.
+ */
+std::vector<CBetOut> GetBetPayouts(int height, const CDrawResults& drawResults)
 {
     std::vector<CBetOut> vExpectedPayouts;
     std::vector<CBetOut> vCompletedPayouts;
@@ -336,14 +460,11 @@ std::vector<CBetOut> GetBetPayouts(int height)
     
     int nTraverseHeight;
 
-    if (!IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*2)) && height % 1500 == 1494) {
-        DownloadResultsFile();
-        return {};
-    } else if (!IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*2)) && height % 1500 == 1496) {
-        DownloadResultsFile2();
+    // Prefetch the results ahead of the payout height, in the background.
+    if (!IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*2)) && (height % 1500 == 1494 || height % 1500 == 1496)) {
+        drawResultOracle.RequestRefresh();
         return {};
-    } else if ((height <= 88500 && height % 1500 == 0 && (chainActive.Tip()->GetBlockTime() > lastdrawtime(chainActive.Tip()->GetBlockTime()) + (60*60*16))) ||
-               (height > 88500 && height % 1500 == 0 && (chainActive.Tip()->GetBlockTime() > lastdrawtime(chainActive.Tip()->GetBlockTime()) + (60*60*18)))) {
+    } else if (IsBetPayoutHeight(height, chainActive.Tip()->GetBlockTime())) {
 
         std::time_t lastdraw = lastdrawtime(chainActive.Tip()->GetBlockTime());
         std::tm * ptm = gmtime(&lastdraw);
@@ -354,7 +475,6 @@ std::vector<CBetOut> GetBetPayouts(int height)
         LogPrintf("%s : Latest Draw Date=%d - Latest Draw Time=%t  - Next Draw Date=%r \n", __func__, lastdrawdate(chainActive.Tip()->GetBlockTime()), chartime, nextdrawdate(chainActive.Tip()->GetBlockTime()));
 
         // Look back the chain 6 days for any events and bets.
-        CBlockIndex *BlocksIndex = NULL;
         if (height - Params().GetConsensus().nBetBlocksIndexTimespan > Params().GetConsensus().height_last_PoW + 1) {
             nTraverseHeight = height - Params().GetConsensus().nBetBlocksIndexTimespan;
         } else if (height <= 1500) { // don't allow betting payouts until block 1500
@@ -362,7 +482,6 @@ std::vector<CBetOut> GetBetPayouts(int height)
         } else {
             nTraverseHeight = Params().GetConsensus().height_last_PoW + 1;
         }
-        BlocksIndex = chainActive[nTraverseHeight];
         LogPrintf("%s : Setting Block Height of %h \n", __func__, nTraverseHeight);
         
         std::time_t latestDrawStartTime = lastdrawtime(chainActive.Tip()->GetBlockTime());
@@ -431,6 +550,16 @@ std::vector<CBetOut> GetBetPayouts(int height)
             }
         }
 
+        // The payouts only depend on the bets and payouts up to the tip, the draw and its results.
+        const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+        CHashWriter ssInputs(SER_GETHASH, 0);
+        ssInputs << height << latestDrawDate << drawResults.hashResults << sporkManager.GetSporkValue(SPORK_19_DRAW_RESULT);
+        const uint256 hashInputs = ssInputs.GetHash();
+        if (betPayoutCache.Get(hashTip, hashInputs, vPendingPayouts)) {
+            LogPrint(BCLog::BETTING, "%s : Using cached payouts for height %d\n", __func__, height);
+            return vPendingPayouts;
+        }
+
         // Read results file for past draws
         std::string NYResult;
         std::string PBResult;
@@ -445,7 +574,7 @@ std::vector<CBetOut> GetBetPayouts(int height)
         std::string resultNum5;
 
         try {
-            NYResult = ReadResultsFile();
+            NYResult = drawResults.strPrimary;
 
             if (!officialResults.read(NYResult) || !officialResults.isArray())
             {
@@ -517,7 +646,7 @@ std::vector<CBetOut> GetBetPayouts(int height)
 
             // Read PowerBall.com results file for past draws
             try {
-                PBResult = ReadResultsFile2();
+                PBResult = drawResults.strBackup;
 
                 if (!officialResults.read(PBResult) || !officialResults.isArray())
                 {
@@ -616,186 +745,104 @@ std::vector<CBetOut> GetBetPayouts(int height)
             LogPrintf("Sporked Results: %s %s %s %s %s %s \n", resultDate, resultNum1, resultNum2, resultNum3, resultNum4, resultNum5);
         }
         
-        double nOneNumberOdds = 12;
-        double nTwoNumberOdds = 200;
-        double nThreeNumberOdds = 3500;
-
-        // Traverse the block chain to find bets.
-        LogPrintf("%s : Traverse the block chain to find bets.\n", __func__);
-        while (BlocksIndex) {
-            CBlock block;
-            ReadBlockFromDisk(block, BlocksIndex);
-            std::time_t transactionTime = block.nTime;
-            
-            for (CTransaction &tx : block.vtx) {
-                // Check all TX vouts for an OP RETURN.
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-
-                    const CTxOut &txout = tx.vout[i];
-                    std::string scriptPubKey = ScriptToAsmStr(txout.scriptPubKey);
-                    CAmount betAmount = txout.nValue;
-
-                    if (scriptPubKey.length() > 0 && strncmp(scriptPubKey.c_str(), "OP_RETURN", 9) == 0) {
-
-                        // Get the OP CODE from the transaction scriptPubKey.
-                        std::vector<unsigned char> vOpCode = ParseHex(scriptPubKey.substr(9, std::string::npos));
-                        std::string opCode(vOpCode.begin(), vOpCode.end());
-
-                        // Only payout bets that are in the specified range (MaxBetPayoutRange).
-                        if (betAmount >= (Params().GetConsensus().nMinBetPayoutRange * COIN) && betAmount <= (Params().GetConsensus().nMaxBetPayoutRange * COIN)) {
-
-                            // Bet OP RETURN transaction.
-                            CLottoBet lb;
-                            if (CLottoBet::FromOpCode(opCode, lb)) {
-
-                                LogPrintf("%s : Block Timestamp: %s : Found a bet for date : %s - Using Selections : [%s] [%s] [%s] \n", __func__, transactionTime, lb.nDate, lb.nNumber1, lb.nNumber2, lb.nNumber3);
-                                CAmount payout = 0 * COIN;
-
-                                // Is the bet a winning bet?
-                                std::ostringstream sDate;
-                                sDate << lb.nDate;
-
-                                bool isWinner = true;
-                                
-                                if (lb.nNumber1 != 0 && lb.nNumber1 != (unsigned int) std::stoi(resultNum1) && lb.nNumber1 != (unsigned int) std::stoi(resultNum2) && lb.nNumber1 != (unsigned int) std::stoi(resultNum3) && lb.nNumber1 != (unsigned int) std::stoi(resultNum4) && lb.nNumber1 != (unsigned int) std::stoi(resultNum5)) {
-                                    isWinner = false;
-                                }
-                                if (lb.nNumber2 != 0 && lb.nNumber2 != (unsigned int) std::stoi(resultNum1) && lb.nNumber2 != (unsigned int) std::stoi(resultNum2) && lb.nNumber2 != (unsigned int) std::stoi(resultNum3) && lb.nNumber2 != (unsigned int) std::stoi(resultNum4) && lb.nNumber2 != (unsigned int) std::stoi(resultNum5)) {
-                                    isWinner = false;
-                                }
-                                if (lb.nNumber3 != 0 && lb.nNumber3 != (unsigned int) std::stoi(resultNum1) && lb.nNumber3 != (unsigned int) std::stoi(resultNum2) && lb.nNumber3 != (unsigned int) std::stoi(resultNum3) && lb.nNumber3 != (unsigned int) std::stoi(resultNum4) && lb.nNumber3 != (unsigned int) std::stoi(resultNum5)) {
-                                    isWinner = false;
-                                }
-                                if ((lb.nNumber1 == lb.nNumber2 && lb.nNumber1 != 0)||(lb.nNumber1 == lb.nNumber3 && lb.nNumber1 != 0)||(lb.nNumber2 == lb.nNumber3 && lb.nNumber2 != 0)) {
-                                    isWinner = false;
-                                }
-                                if (lb.nNumber1 > 69 || lb.nNumber2 > 69 || lb.nNumber3 > 69) {
-                                    isWinner = false;
-                                }
-                                if (lb.nNumber1 == 0 && lb.nNumber2 == 0 && lb.nNumber3 == 0) {
-                                    isWinner = false;
-                                }
-
-                                // If bet was placed less than X mins before event start or after event start discard it.
-                                if ((unsigned int) transactionTime > (latestDrawStartTime - Params().GetConsensus().nBetPlaceTimeoutBlocks)) {
-                                    LogPrintf("%s : Bet placed too late. Draw Started: %t - Bet Placed - %u \n", __func__, latestDrawStartTime, transactionTime);
-                                    isWinner = false;
-                                }
-
-                                // If bet isn't for latest draw, discard it
-                                if (resultDate != sDate.str()) {
-                                    LogPrintf("%s : Bet not for latest draw: Bet for draw date: %t - Latest Results Date: %u \n", __func__, sDate.str(), resultDate);
-                                    isWinner = false;
-                                }                                
-                                
-                                if (resultDate == sDate.str() && isWinner) {
-
-                                    // Calculate winnings.
-                                    if (lb.nNumber3 > 0 && lb.nNumber2 > 0 && lb.nNumber1 > 0) {
-                                        payout = betAmount * nThreeNumberOdds;
-                                    }
-                                    else if ((lb.nNumber1 > 0 && lb.nNumber2 > 0)||(lb.nNumber1 > 0 && lb.nNumber3 > 0)||(lb.nNumber2 > 0 && lb.nNumber3 > 0)) {
-                                        payout = betAmount * nTwoNumberOdds;
-                                    }
-                                    else if (lb.nNumber1 > 0 || lb.nNumber2 > 0 || lb.nNumber3 > 0) {
-                                       payout = betAmount * nOneNumberOdds;
-                                    }
-                                    else {
-                                        payout = 0;
-                                    }
-
-                                    // Get the users payout address from the vin of the bet TX they used to place the bet.
-                                    CTxDestination payoutAddress;
-                                    const CTxIn &txin = tx.vin[0];
-                                    COutPoint prevout = txin.prevout;
-
-                                    uint256 hashBlock;
-                                    CTransaction txPrev;
-                                    if (GetTransaction(prevout.hash, txPrev, hashBlock, true)) {
-                                        ExtractDestination( txPrev.vout[prevout.n].scriptPubKey, payoutAddress );
-                                    }
-
-                                    // Only add valid payouts to the vExpectedPayouts vector.
-                                    if (payout > 0 && payout <= (Params().GetConsensus().nMaxWinnerPayout * COIN)) {
-                                        // Add winning bet payout to the bet vector.
-                                        vExpectedPayouts.emplace_back(payout, GetScriptForDestination(CBitcoinAddress(payoutAddress).Get()), betAmount);
-
-                                        LogPrintf("Winning Line - PAYOUT\n");
-                                        LogPrintf("AMOUNT: %li \n", payout);
-                                        LogPrintf("NUMBER1: %li \n", lb.nNumber1);
-                                        LogPrintf("NUMBER2: %li \n", lb.nNumber2);
-                                        LogPrintf("NUMBER3: %li \n", lb.nNumber3);
-                                        LogPrintf("ADDRESS: %s \n", CBitcoinAddress( payoutAddress ).ToString().c_str());
-                                    } else {
-                                        LogPrintf("%s : Bet payout of %t outside permitted range. \n", __func__, payout);
-                                        isWinner = false;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+        // Bets for any other draw date never win, so only the bets placed on the latest draw are read.
+        int32_t nResultDate = 0;
+        std::vector<std::pair<CBetIndexKey, CBetIndexEntry> > vBets;
+        std::vector<std::pair<int, CBetPayoutRecord> > vPayoutRecords;
+        LogPrintf("%s : Read the bet index to find bets.\n", __func__);
+        if (ParseInt32(resultDate, &nResultDate) && std::to_string(nResultDate) == resultDate &&
+                !pbetDB->ReadDrawBets(nResultDate, nTraverseHeight, chainActive.Height(), vBets)) {
+            LogPrintf("%s : Failed to read bets for draw %s\n", __func__, resultDate);
+        }
+        if (!pbetDB->ReadBetPayouts(nTraverseHeight, chainActive.Height(), vPayoutRecords)) {
+            LogPrintf("%s : Failed to read bet payouts\n", __func__);
+        }
+
+        for (const auto& bet : vBets) {
+            const CBetIndexKey& key = bet.first;
+            const CBetIndexEntry& entry = bet.second;
+
+            // Skip records left behind by blocks that are no longer in the active chain.
+            const CBlockIndex* pindexBet = chainActive[key.nHeight];
+            if (!pindexBet || pindexBet->GetBlockHash() != entry.hashBlock)
+                continue;
+
+            std::time_t transactionTime = entry.nBlockTime;
+            CAmount betAmount = entry.nBetValue;
+            CLottoBet lb(key.nDate, entry.nNumber1, entry.nNumber2, entry.nNumber3);
+
+            LogPrintf("%s : Block Timestamp: %s : Found a bet for date : %s - Using Selections : [%s] [%s] [%s] \n", __func__, transactionTime, lb.nDate, lb.nNumber1, lb.nNumber2, lb.nNumber3);
+            CAmount payout = 0 * COIN;
+
+            bool isWinner = true;
+
+            if (lb.nNumber1 != 0 && lb.nNumber1 != (unsigned int) std::stoi(resultNum1) && lb.nNumber1 != (unsigned int) std::stoi(resultNum2) && lb.nNumber1 != (unsigned int) std::stoi(resultNum3) && lb.nNumber1 != (unsigned int) std::stoi(resultNum4) && lb.nNumber1 != (unsigned int) std::stoi(resultNum5)) {
+                isWinner = false;
+            }
+            if (lb.nNumber2 != 0 && lb.nNumber2 != (unsigned int) std::stoi(resultNum1) && lb.nNumber2 != (unsigned int) std::stoi(resultNum2) && lb.nNumber2 != (unsigned int) std::stoi(resultNum3) && lb.nNumber2 != (unsigned int) std::stoi(resultNum4) && lb.nNumber2 != (unsigned int) std::stoi(resultNum5)) {
+                isWinner = false;
+            }
+            if (lb.nNumber3 != 0 && lb.nNumber3 != (unsigned int) std::stoi(resultNum1) && lb.nNumber3 != (unsigned int) std::stoi(resultNum2) && lb.nNumber3 != (unsigned int) std::stoi(resultNum3) && lb.nNumber3 != (unsigned int) std::stoi(resultNum4) && lb.nNumber3 != (unsigned int) std::stoi(resultNum5)) {
+                isWinner = false;
+            }
+            if ((lb.nNumber1 == lb.nNumber2 && lb.nNumber1 != 0)||(lb.nNumber1 == lb.nNumber3 && lb.nNumber1 != 0)||(lb.nNumber2 == lb.nNumber3 && lb.nNumber2 != 0)) {
+                isWinner = false;
+            }
+            if (lb.nNumber1 > 69 || lb.nNumber2 > 69 || lb.nNumber3 > 69) {
+                isWinner = false;
+            }
+            if (lb.nNumber1 == 0 && lb.nNumber2 == 0 && lb.nNumber3 == 0) {
+                isWinner = false;
+            }
+
+            // If bet was placed less than X mins before event start or after event start discard it.
+            if ((unsigned int) transactionTime > (latestDrawStartTime - Params().GetConsensus().nBetPlaceTimeoutBlocks)) {
+                LogPrintf("%s : Bet placed too late. Draw Started: %t - Bet Placed - %u \n", __func__, latestDrawStartTime, transactionTime);
+                isWinner = false;
             }
 
-            CTransaction &cbtx = block.vtx[1]; 
-            if (cbtx.vout.size() > 1 && transactionTime >= latestDrawStartTime) {        
+            if (isWinner) {
 
-                // Get the vin staking value so we can use it to find out how many staking TX in the vouts.
-                const CTxIn &txin = cbtx.vin[0];
-                COutPoint cbprevout = txin.prevout;
-                unsigned int numStakingTx = 0;
-                CAmount stakeAmount = 0;
+                // Calculate winnings.
+                payout = GetLottoBetPayout(lb, betAmount);
 
-                uint256 cbHashBlock;
-                CTransaction cbTxPrev;
+                // Only add valid payouts to the vExpectedPayouts vector.
+                if (payout > 0 && payout <= (Params().GetConsensus().nMaxWinnerPayout * COIN)) {
+                    // Add winning bet payout to the bet vector.
+                    vExpectedPayouts.emplace_back(payout, entry.scriptPayout, betAmount);
 
-                if (GetTransaction(cbprevout.hash, cbTxPrev, cbHashBlock, true)) {
-                    const CTxOut &prevCbTxOut = cbTxPrev.vout[cbprevout.n];
-                    stakeAmount = prevCbTxOut.nValue;
+                    CTxDestination payoutAddress;
+                    ExtractDestination(entry.scriptPayout, payoutAddress);
+                    LogPrintf("Winning Line - PAYOUT\n");
+                    LogPrintf("AMOUNT: %li \n", payout);
+                    LogPrintf("NUMBER1: %li \n", lb.nNumber1);
+                    LogPrintf("NUMBER2: %li \n", lb.nNumber2);
+                    LogPrintf("NUMBER3: %li \n", lb.nNumber3);
+                    LogPrintf("ADDRESS: %s \n", CBitcoinAddress( payoutAddress ).ToString().c_str());
+                } else {
+                    LogPrintf("%s : Bet payout of %t outside permitted range. \n", __func__, payout);
+                    isWinner = false;
                 }
+            }
+        }
 
-                // Count the coinbase and staking vouts in the current block TX.
-                CAmount totalStakeAcc = 0;
-                for (unsigned int i = 0; i < cbtx.vout.size(); i++) {
-                    const CTxOut &cbtxout = cbtx.vout[i];
-                    CAmount voutValue = cbtxout.nValue;
-                                        
-                    if (totalStakeAcc < stakeAmount + GetBlockValue(nTraverseHeight) - GetMasternodePayment()) {
-                        numStakingTx++;
-                    }
-                    else {
-                        i = cbtx.vout.size();
-                        break;
-                    }
+        // Add bets paid out since the draw started to vCompletedPayouts vector
+        for (const auto& payoutRecord : vPayoutRecords) {
+            const CBetPayoutRecord& record = payoutRecord.second;
+            const CBlockIndex* pindexPaid = chainActive[payoutRecord.first];
+            if (!pindexPaid || pindexPaid->GetBlockHash() != record.hashBlock)
+                continue;
+            if (record.nBlockTime < latestDrawStartTime)
+                continue;
 
-                    totalStakeAcc += voutValue;
-                }
-                
-                // Add paid out bets to vCompletedPayouts vector
-                for (unsigned int j = 0; j < cbtx.vout.size() - numStakingTx; j++) {
-                    unsigned int i = numStakingTx + j;
-
-                    const CTxOut &cbtxout = cbtx.vout[i];
-                    CAmount voutValue = cbtxout.nValue;
-
-                    // Get the bet payout address.
-                    CTxDestination betAddr;
-                    ExtractDestination(cbtx.vout[i].scriptPubKey, betAddr);
-                    std::string betAddrS = CBitcoinAddress(betAddr).ToString();
-
-                    if ( i == (cbtx.vout.size() - 1) and voutValue == (GetMasternodePayment())) {
-                        LogPrintf("GetBetPayouts: Masternode Address: %s  - Masternode Payment Amount: %s \n", betAddrS.c_str(),voutValue);
-                    } else {
-                        LogPrintf("GetBetPayouts: Bet Address: %s  - Processed Bet Amount: %s \n", betAddrS.c_str(),voutValue);
-                        vCompletedPayouts.emplace_back(voutValue, cbtx.vout[i].scriptPubKey, 0);
-                    }
-                }
+            for (const CTxOut& paid : record.vPaid) {
+                CTxDestination betAddr;
+                ExtractDestination(paid.scriptPubKey, betAddr);
+                LogPrintf("GetBetPayouts: Bet Address: %s  - Processed Bet Amount: %s \n", CBitcoinAddress(betAddr).ToString().c_str(), paid.nValue);
+                vCompletedPayouts.emplace_back(paid.nValue, paid.scriptPubKey, 0);
             }
-                            
-            nTraverseHeight ++;
-            BlocksIndex = chainActive.Next(BlocksIndex);
         }
-        
+
         unsigned long vExpectedSize = vExpectedPayouts.size();
         unsigned long vCompletedSize = vCompletedPayouts.size();
 
@@ -852,11 +899,171 @@ std::vector<CBetOut> GetBetPayouts(int height)
                 betPaid = false;
             }
         }
+
+        betPayoutCache.Put(hashTip, hashInputs, vPendingPayouts);
     }
     
     return vPendingPayouts;
 }
 
+/**
+ * Decodes a lotto bet output. Only bets that are in the specified range (MaxBetPayoutRange) are accepted.
+ *
+ * @param txout The transaction output
+ * @param lb    The decoded CLottoBet
+ * @return      Bool
+ */
+static bool DecodeLottoBetOutput(const CTxOut& txout, CLottoBet& lb)
+{
+    if (txout.nValue < (Params().GetConsensus().nMinBetPayoutRange * COIN) || txout.nValue > (Params().GetConsensus().nMaxBetPayoutRange * COIN))
+        return false;
+
+    return CLottoBet::FromScript(txout.scriptPubKey, lb);
+}
+
+void GetBlockLottoBets(const CBlock& block, std::vector<CBlockLottoBet>& vBets)
+{
+    for (unsigned int nTx = 0; nTx < block.vtx.size(); nTx++) {
+        const CTransaction& tx = block.vtx[nTx];
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            CLottoBet lb;
+            if (DecodeLottoBetOutput(tx.vout[i], lb))
+                vBets.emplace_back(nTx, i, tx.vout[i].nValue, lb);
+        }
+    }
+}
+
+/**
+ * Collects the bet index records of a block transaction.
+ *
+ * @param tx      The transaction
+ * @param nTx     Position of the transaction in its block
+ * @param pindex  The block index of the block holding the transaction
+ * @param pprevout The output spent by the first input of tx, NULL for coinbases and zerocoin spends
+ * @param vBets   Receives the lotto bets placed by tx
+ * @param vPaid   Receives the bet payouts made by tx, when it is the coinstake
+ */
+void IndexBetTransaction(const CTransaction& tx, unsigned int nTx, const CBlockIndex* pindex, const CTxOut* pprevout,
+                         std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets, std::vector<CTxOut>& vPaid)
+{
+    CScript scriptPayout;
+    bool fPayoutResolved = false;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        CLottoBet lb;
+        if (!DecodeLottoBetOutput(tx.vout[i], lb))
+            continue;
+
+        // Get the users payout address from the vin of the bet TX they used to place the bet.
+        if (!fPayoutResolved) {
+            CTxDestination payoutAddress;
+            if (pprevout)
+                ExtractDestination(pprevout->scriptPubKey, payoutAddress);
+            scriptPayout = GetScriptForDestination(CBitcoinAddress(payoutAddress).Get());
+            fPayoutResolved = true;
+        }
+
+        CBetIndexEntry entry;
+        entry.hashBlock = pindex->GetBlockHash();
+        entry.nBlockTime = pindex->GetBlockTime();
+        entry.nBetValue = tx.vout[i].nValue;
+        entry.nNumber1 = lb.nNumber1;
+        entry.nNumber2 = lb.nNumber2;
+        entry.nNumber3 = lb.nNumber3;
+        entry.scriptPayout = scriptPayout;
+        vBets.emplace_back(CBetIndexKey(lb.nDate, pindex->nHeight, nTx, i), entry);
+    }
+
+    // The bets are paid out by the coinstake, after the staking vouts.
+    if (nTx != 1 || tx.vout.size() <= 1 || tx.vin.empty())
+        return;
+
+    // Get the vin staking value so we can use it to find out how many staking TX in the vouts.
+    CAmount stakeAmount = 0;
+    if (pprevout)
+        stakeAmount = pprevout->nValue;
+
+    // Count the coinbase and staking vouts in the current block TX.
+    unsigned int numStakingTx = 0;
+    CAmount totalStakeAcc = 0;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        if (totalStakeAcc >= stakeAmount + GetBlockValue(pindex->nHeight) - GetMasternodePayment())
+            break;
+        numStakingTx++;
+        totalStakeAcc += tx.vout[i].nValue;
+    }
+
+    for (unsigned int i = numStakingTx; i < tx.vout.size(); i++) {
+        // The last vout is the masternode payment.
+        if (i == tx.vout.size() - 1 && tx.vout[i].nValue == GetMasternodePayment())
+            continue;
+        vPaid.push_back(tx.vout[i]);
+    }
+}
+
+std::vector<CBetIndexKey> GetBlockBetIndexKeys(const CBlock& block, int nHeight)
+{
+    std::vector<CBlockLottoBet> vBets;
+    GetBlockLottoBets(block, vBets);
+
+    std::vector<CBetIndexKey> vKeys;
+    vKeys.reserve(vBets.size());
+    for (const CBlockLottoBet& bet : vBets)
+        vKeys.emplace_back(bet.bet.nDate, nHeight, bet.nTx, bet.nOut);
+    return vKeys;
+}
+
+std::string ReindexBetDB()
+{
+    AssertLockHeld(cs_main);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nTipHeight = chainActive.Height();
+    const int nStartHeight = std::max(consensus.height_last_PoW + 1, nTipHeight - consensus.nBetBlocksIndexTimespan);
+
+    uiInterface.ShowProgress(_("Reindexing bet database..."), 0);
+
+    CBlockIndex* pindex = chainActive[nStartHeight];
+    while (pindex) {
+        uiInterface.ShowProgress(_("Reindexing bet database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - nStartHeight) / (double)std::max(1, nTipHeight - nStartHeight) * 100))));
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return _("Reindexing bet database failed");
+        }
+
+        // The payout addresses come from the spent outputs kept in the undo data, like
+        // ConnectBlock takes them from the coins view: they may be gone from disk otherwise.
+        CBlockUndo blockUndo;
+        const CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !blockUndo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()) ||
+                blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+            return _("Reindexing bet database failed");
+        }
+
+        std::vector<std::pair<CBetIndexKey, CBetIndexEntry> > vBets;
+        std::vector<CTxOut> vPaid;
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            const CTxOut* pprevout = NULL;
+            if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
+                const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+                if (txundo.vprevout.size() != tx.vin.size())
+                    return _("Reindexing bet database failed");
+                pprevout = &txundo.vprevout[0].txout;
+            }
+            IndexBetTransaction(tx, i, pindex, pprevout, vBets, vPaid);
+        }
+
+        if (!pbetDB->WriteBlockBets(pindex, vBets, vPaid))
+            return _("Error writing bet database to disk");
+
+        pindex = chainActive.Next(pindex);
+    }
+    uiInterface.ShowProgress("", 100);
+
+    return "";
+}
+
 std::time_t lastdrawtime(std::time_t blockTime)
 {
     std::tm * lDrawTime = std::gmtime(&blockTime);
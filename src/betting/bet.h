@@ -8,12 +8,21 @@
 
 #include "util.h"
 #include "chainparams.h"
+#include "sync.h"
+#include "validationinterface.h"
 
 #include <boost/filesystem/path.hpp>
+#include <deque>
 #include <map>
 #include <iomanip>
 #include <univalue/include/univalue.h>
 
+class CBlockIndex;
+class CCoinsViewCache;
+struct CDrawResults;
+struct CBetIndexEntry;
+struct CBetIndexKey;
+
 // The supported betting TX types.
 typedef enum BetTxTypes{
     plBetTxType          = 0x01,  // Peerless Bet transaction type identifier.
@@ -93,10 +102,78 @@ public:
 
     static bool ToOpCode(CLottoBet pb, std::string &opCode);
     static bool FromOpCode(std::string opCode, CLottoBet &pb);
+    /** Decode a lotto bet straight from an OP_RETURN output script. **/
+    static bool FromScript(const CScript& script, CLottoBet &pb);
+};
+
+/** A lotto bet output of a block. **/
+struct CBlockLottoBet {
+    uint32_t nTx;
+    uint32_t nOut;
+    CAmount nBetValue;
+    CLottoBet bet;
+
+    CBlockLottoBet(uint32_t nTxIn, uint32_t nOutIn, CAmount nBetValueIn, const CLottoBet& betIn) :
+            nTx(nTxIn), nOut(nOutIn), nBetValue(nBetValueIn), bet(betIn) {}
+};
+
+/** Decode all the lotto bet outputs of a block that are within the accepted bet range, in block order. **/
+void GetBlockLottoBets(const CBlock& block, std::vector<CBlockLottoBet>& vBets);
+
+/**
+ * Memoizes the payout vectors computed by GetBetPayouts, so that the payouts of a
+ * block are computed once whether it is built by this node, validated or revalidated.
+ * Entries are keyed by the chain tip the bets were scanned up to and a hash of the
+ * other inputs (height, draw date, draw results). They are dropped when their tip
+ * is disconnected.
+ */
+class CBetPayoutCache : public CValidationInterface
+{
+public:
+    static const size_t MAX_ENTRIES = 16;
+
+    bool Get(const uint256& hashTip, const uint256& hashInputs, std::vector<CBetOut>& vPayouts) const;
+    void Put(const uint256& hashTip, const uint256& hashInputs, const std::vector<CBetOut>& vPayouts);
+    void Clear();
+
+protected:
+    void BlockDisconnected(const CBlock& block, const CBlockIndex* pindex);
+
+private:
+    struct Entry {
+        uint256 hashTip;
+        uint256 hashInputs;
+        std::vector<CBetOut> vPayouts;
+    };
+
+    mutable RecursiveMutex cs;
+    std::deque<Entry> entries;
 };
 
+extern CBetPayoutCache betPayoutCache;
+
+/** Whether the block at height, on top of a tip with time nTipTime, pays out the bets of the last draw. **/
+bool IsBetPayoutHeight(int height, std::time_t nTipTime);
+
+/** The date (YYYYMMDD) of the draw paid out by a payout block on top of a tip with time nTipTime. **/
+uint32_t GetPaidDrawDate(std::time_t nTipTime);
+
+/** The amount paid for a winning lotto bet of nBetValue. **/
+CAmount GetLottoBetPayout(const CLottoBet& lb, CAmount nBetValue);
+
 /** Get the lotto winning bets from the block chain and return the payout vector. **/
 std::vector<CBetOut> GetBetPayouts(int height);
+std::vector<CBetOut> GetBetPayouts(int height, const CDrawResults& drawResults);
+
+/** Collect the bet index records of a block transaction: the lotto bets it places and, for the coinstake, the bet payouts it makes. **/
+void IndexBetTransaction(const CTransaction& tx, unsigned int nTx, const CBlockIndex* pindex, const CTxOut* pprevout,
+                         std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets, std::vector<CTxOut>& vPaid);
+
+/** Bet index keys of all the lotto bets placed in a block. **/
+std::vector<CBetIndexKey> GetBlockBetIndexKeys(const CBlock& block, int nHeight);
+
+/** Rebuild the bet index over the payout window behind the chain tip. **/
+std::string ReindexBetDB();
 
 std::time_t lastdrawtime(std::time_t blockTime);
 
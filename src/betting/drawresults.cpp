@@ -0,0 +1,163 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "betting/drawresults.h"
+
+#include "consensus/validation.h"
+#include "hash.h"
+#include "main.h"
+#include "scheduler.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <univalue.h>
+
+#include <boost/bind.hpp>
+
+static bool FetchPrimaryResults(std::string& strResults)
+{
+    DownloadResultsFile();
+    strResults = ReadResultsFile();
+    return !strResults.empty();
+}
+
+static bool FetchBackupResults(std::string& strResults)
+{
+    DownloadResultsFile2();
+    strResults = ReadResultsFile2();
+    return !strResults.empty();
+}
+
+CDrawResultOracle drawResultOracle(FetchPrimaryResults, FetchBackupResults);
+
+/** A results document is only used if it parses to a non-empty array of draws. */
+static bool FetchValidResults(const CDrawResultOracle::Source& source, std::string& strResults)
+{
+    try {
+        UniValue results;
+        if (!source(strResults) || !results.read(strResults) || !results.isArray() || results.empty())
+            return false;
+    } catch (const std::exception& e) {
+        LogPrintf("%s : Error fetching draw results: %s\n", __func__, e.what());
+        return false;
+    }
+    return true;
+}
+
+CDrawResultOracle::CDrawResultOracle(Source primaryIn, Source backupIn) :
+        primary(primaryIn),
+        backup(backupIn),
+        snapshot(std::make_shared<const CDrawResults>()),
+        pscheduler(nullptr),
+        fRefreshQueued(false)
+{
+}
+
+void CDrawResultOracle::Start(CScheduler& schedulerIn)
+{
+    LOCK(cs);
+    pscheduler = &schedulerIn;
+}
+
+bool CDrawResultOracle::Refresh()
+{
+    // Fetch without holding the lock: readers keep using the previous snapshot meanwhile.
+    std::string strPrimary, strBackup;
+    bool fPrimary = FetchValidResults(primary, strPrimary);
+    bool fBackup = FetchValidResults(backup, strBackup);
+
+    LOCK(cs);
+    // Keep the previous results of a source that failed to produce valid ones.
+    std::shared_ptr<CDrawResults> next = std::make_shared<CDrawResults>(*snapshot);
+    next->nVersion++;
+    next->nTime = GetTime();
+    next->fFetched = fPrimary || fBackup;
+    if (fPrimary)
+        next->strPrimary = strPrimary;
+    if (fBackup)
+        next->strBackup = strBackup;
+    next->hashResults = Hash(next->strPrimary.begin(), next->strPrimary.end(), next->strBackup.begin(), next->strBackup.end());
+    snapshot = next;
+
+    LogPrint(BCLog::BETTING, "%s : draw results version %d (primary %s, backup %s)\n", __func__, next->nVersion,
+             fPrimary ? "updated" : "unchanged", fBackup ? "updated" : "unchanged");
+    return fPrimary || fBackup;
+}
+
+void CDrawResultOracle::RequestRefresh(int64_t nDelay)
+{
+    LOCK(cs);
+    if (!pscheduler || fRefreshQueued)
+        return;
+    fRefreshQueued = true;
+    pscheduler->scheduleFromNow(boost::bind(&CDrawResultOracle::ScheduledRefresh, this), nDelay);
+}
+
+void CDrawResultOracle::ScheduledRefresh()
+{
+    {
+        LOCK(cs);
+        fRefreshQueued = false;
+    }
+
+    Refresh();
+
+    bool fRetry;
+    {
+        LOCK(cs);
+        fRetry = !mapParkedBlocks.empty();
+    }
+    if (fRetry) {
+        // Retry the parked blocks against the refreshed results
+        CValidationState state;
+        ActivateBestChain(state);
+    }
+}
+
+std::shared_ptr<const CDrawResults> CDrawResultOracle::GetSnapshot() const
+{
+    LOCK(cs);
+    return snapshot;
+}
+
+bool CDrawResultOracle::ParkBlock(const uint256& hashBlock, const CDrawResults& drawResults)
+{
+    bool fRequest = false;
+    int64_t nDelay = 0;
+    {
+        LOCK(cs);
+        std::map<uint256, int>::iterator it = mapParkedBlocks.find(hashBlock);
+        if (it != mapParkedBlocks.end() && drawResults.nVersion > it->second) {
+            if (drawResults.fFetched) {
+                // Already retried against fresher results
+                mapParkedBlocks.erase(it);
+                return false;
+            }
+            // The refresh failed, so our results may still be stale: wait for the next one
+            it->second = drawResults.nVersion;
+            fRequest = true;
+            nDelay = DRAW_RESULTS_RETRY_INTERVAL;
+        } else if (it == mapParkedBlocks.end()) {
+            if (mapParkedBlocks.size() >= MAX_PARKED_BLOCKS) {
+                // An evicted block is parked anew when it is retried, it only waits for one more refresh
+                LogPrint(BCLog::BETTING, "%s : too many parked blocks, forgetting block %s\n", __func__, mapParkedBlocks.begin()->first.GetHex());
+                mapParkedBlocks.erase(mapParkedBlocks.begin());
+            }
+            mapParkedBlocks.emplace(hashBlock, drawResults.nVersion);
+            fRequest = true;
+        }
+    }
+
+    if (fRequest) {
+        LogPrintf("%s : block %s waits for refreshed draw results\n", __func__, hashBlock.GetHex());
+        RequestRefresh(nDelay);
+    }
+    return true;
+}
+
+void CDrawResultOracle::UnparkBlock(const uint256& hashBlock)
+{
+    LOCK(cs);
+    mapParkedBlocks.erase(hashBlock);
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef POWERALT_DRAWRESULTS_H
+#define POWERALT_DRAWRESULTS_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+class CScheduler;
+
+//! Maximum number of blocks parked waiting for refreshed draw results
+static const unsigned int MAX_PARKED_BLOCKS = 100;
+//! Seconds between the refreshes asked for while the draw result sources can't be reached
+static const int64_t DRAW_RESULTS_RETRY_INTERVAL = 60;
+
+/** The draw results published by the primary (data.ny.gov) and backup (powerball.com) sources. */
+struct CDrawResults {
+    //! Number of completed fetch rounds when this snapshot was taken
+    int nVersion;
+    //! Time of the last fetch round
+    int64_t nTime;
+    //! Whether the last fetch round got valid results from at least one source
+    bool fFetched;
+    std::string strPrimary;
+    std::string strBackup;
+    //! Hash of both documents, identifies the results that payouts were computed from
+    uint256 hashResults;
+
+    CDrawResults() : nVersion(0), nTime(0), fFetched(false) {}
+};
+
+/**
+ * Fetches the draw results in the background on the scheduler thread, so that
+ * block validation never waits on the network while holding cs_main.
+ * Validation reads an immutable snapshot of the last fetched results.
+ *
+ * A payout block that doesn't validate against the current snapshot is parked:
+ * a refresh is requested and the block is retried once that fetch round has
+ * completed. It is only rejected if it still doesn't validate against results
+ * that were fetched successfully since. While the sources can't be reached the
+ * block stays parked and is retried after every fetch round, it is never
+ * rejected on our own stale results.
+ */
+class CDrawResultOracle
+{
+public:
+    //! Fetches one results document. Returns false if nothing could be fetched.
+    typedef std::function<bool(std::string&)> Source;
+
+    CDrawResultOracle(Source primaryIn, Source backupIn);
+
+    /** Run the fetches requested from now on on the given scheduler. */
+    void Start(CScheduler& schedulerIn);
+
+    /** Fetch both sources now, on the calling thread. Returns false if neither produced valid results. */
+    bool Refresh();
+
+    /** Ask for a refresh on the scheduler thread in nDelay seconds. Returns immediately. */
+    void RequestRefresh(int64_t nDelay = 0);
+
+    std::shared_ptr<const CDrawResults> GetSnapshot() const;
+
+    /**
+     * Called when the payouts of a block don't match the results of drawResults.
+     * Returns true if the block should wait for a refresh, false if it was already
+     * retried against results fetched successfully since and must be rejected.
+     */
+    bool ParkBlock(const uint256& hashBlock, const CDrawResults& drawResults);
+
+    /** Forget a parked block once it has been validated. */
+    void UnparkBlock(const uint256& hashBlock);
+
+private:
+    mutable RecursiveMutex cs;
+    Source primary;
+    Source backup;
+    std::shared_ptr<const CDrawResults> snapshot;
+    CScheduler* pscheduler;
+    bool fRefreshQueued;
+    //! Parked blocks and the snapshot version they failed against
+    std::map<uint256, int> mapParkedBlocks;
+
+    void ScheduledRefresh();
+};
+
+extern CDrawResultOracle drawResultOracle;
+
+#endif // POWERALT_DRAWRESULTS_H
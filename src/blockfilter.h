@@ -0,0 +1,136 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * This implements a Golomb-coded set as defined in BIP 158. It is a
+ * compact, probabilistic data structure for testing set membership.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params {
+        uint64_t m_siphash_k0;
+        uint64_t m_siphash_k1;
+        uint8_t m_P;  //!< Golomb-Rice coding parameter
+        uint32_t m_M; //!< Inverse false positive rate
+
+        Params(uint64_t siphash_k0 = 0, uint64_t siphash_k1 = 0, uint8_t P = 0, uint32_t M = 1)
+            : m_siphash_k0(siphash_k0), m_siphash_k1(siphash_k1), m_P(P), m_M(M)
+        {}
+    };
+
+private:
+    Params m_params;
+    uint32_t m_N; //!< Number of elements in the filter
+    uint64_t m_F; //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> m_encoded;
+
+    /** Hash a data element to an integer in the range [0, N * M). */
+    uint64_t HashToRange(const Element& element) const;
+
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+
+    /** Helper method used to implement Match and MatchAny */
+    bool MatchInternal(const uint64_t* element_hashes, size_t size) const;
+
+public:
+    /** Constructs an empty filter. */
+    explicit GCSFilter(const Params& params = Params());
+
+    /** Reconstructs an already-created filter from an encoding. */
+    GCSFilter(const Params& params, const std::vector<unsigned char>& encoded_filter);
+
+    /** Builds a new filter from the params and set of elements. */
+    GCSFilter(const Params& params, const ElementSet& elements);
+
+    uint32_t GetN() const { return m_N; }
+    const Params& GetParams() const { return m_params; }
+    const std::vector<unsigned char>& GetEncoded() const { return m_encoded; }
+
+    /**
+     * Checks if the element may be in the set. False positives are possible
+     * with probability 1/M.
+     */
+    bool Match(const Element& element) const;
+
+    /**
+     * Checks if any of the given elements may be in the set. False positives
+     * are possible with probability 1/M per element checked. This is more
+     * efficient that checking Match on multiple elements separately.
+     */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/**
+ * The basic BIP 158 filter of a block: the scripts of the outputs created and
+ * spent by the block. The two key hashes of a cold staking script are added as
+ * P2PKH scripts as well, so that a wallet can match them without knowing the
+ * other party's key.
+ */
+class BlockFilter
+{
+private:
+    uint256 m_block_hash;
+    GCSFilter m_filter;
+
+    void BuildParams(GCSFilter::Params& params) const;
+
+public:
+    BlockFilter() {}
+
+    /** Reconstruct a BlockFilter from parts. */
+    BlockFilter(const uint256& block_hash, const std::vector<unsigned char>& filter);
+
+    /** Construct the filter of a block from the block and its undo data. */
+    BlockFilter(const CBlock& block, const CBlockUndo& block_undo);
+
+    const uint256& GetBlockHash() const { return m_block_hash; }
+    const GCSFilter& GetFilter() const { return m_filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return m_filter.GetEncoded(); }
+
+    /** Compute the filter hash. */
+    uint256 GetHash() const;
+
+    /** Compute the filter header given the previous one. */
+    uint256 ComputeHeader(const uint256& prev_header) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        std::vector<unsigned char> encoded_filter;
+        if (!ser_action.ForRead())
+            encoded_filter = m_filter.GetEncoded();
+        READWRITE(m_block_hash);
+        READWRITE(encoded_filter);
+        if (ser_action.ForRead()) {
+            GCSFilter::Params params;
+            BuildParams(params);
+            m_filter = GCSFilter(params, encoded_filter);
+        }
+    }
+};
+
+/** The scripts a block filter is built from, see BlockFilter */
+GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& block_undo);
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -8,6 +8,10 @@
 
 #include "chain.h"
 #include "legacy/stakemodifier.h"  // for ComputeNextStakeModifier
+#include "memusage.h"
+#include "sync.h"
+
+#include <set>
 
 
 /**
@@ -74,7 +78,7 @@ CBlockIndex::CBlockIndex(const CBlock& block):
         nNonce{block.nNonce}
 {
     if(block.nVersion > 3 && block.nVersion < 7)
-        nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
+        SetAccumulatorCheckpoint(block.nAccumulatorCheckpoint);
     if (block.IsProofOfStake())
         SetProofOfStake();
 }
@@ -116,7 +120,7 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     block.nTime = nTime;
     block.nBits = nBits;
     block.nNonce = nNonce;
-    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
     return block;
 }
 
@@ -241,6 +245,49 @@ uint256 CBlockIndex::GetStakeModifierV2() const
     return nStakeModifier;
 }
 
+/**
+ * The distinct accumulator checkpoints of the block index entries. A checkpoint only
+ * changes every few blocks, the entries point to the pooled value instead of holding
+ * a copy. Set elements keep their address, so reads need no lock.
+ */
+static RecursiveMutex cs_accumulatorCheckpoints;
+static std::set<uint256> setAccumulatorCheckpoints;
+
+uint256 CBlockIndex::GetAccumulatorCheckpoint() const
+{
+    if (nVersion < 4 || nVersion > 6 || !pAccumulatorCheckpoint)
+        return UINT256_ZERO;
+    return *pAccumulatorCheckpoint;
+}
+
+void CBlockIndex::SetAccumulatorCheckpoint(const uint256& nCheckpoint)
+{
+    if (nCheckpoint.IsNull()) {
+        pAccumulatorCheckpoint = nullptr;
+        return;
+    }
+    LOCK(cs_accumulatorCheckpoints);
+    pAccumulatorCheckpoint = &*setAccumulatorCheckpoints.insert(nCheckpoint).first;
+}
+
+size_t CBlockIndex::CountAccumulatorCheckpoints()
+{
+    LOCK(cs_accumulatorCheckpoints);
+    return setAccumulatorCheckpoints.size();
+}
+
+size_t CBlockIndex::DynamicAccumulatorCheckpointsUsage()
+{
+    LOCK(cs_accumulatorCheckpoints);
+    return memusage::DynamicUsage(setAccumulatorCheckpoints);
+}
+
+void CBlockIndex::ClearAccumulatorCheckpoints()
+{
+    LOCK(cs_accumulatorCheckpoints);
+    setAccumulatorCheckpoints.clear();
+}
+
 //! Check whether this block index entry is valid up to the passed validity level.
 bool CBlockIndex::IsValid(enum BlockStatus nUpTo) const
 {
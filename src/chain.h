@@ -20,7 +20,10 @@
 #include "uint256.h"
 #include "util.h"
 #include "libzerocoin/Denominations.h"
+#include "prevector.h"
 
+#include <new>
+#include <utility>
 #include <vector>
 
 class CBlockFileInfo
@@ -215,8 +218,8 @@ public:
 
     // proof-of-stake specific fields
     // char vector holding the stake modifier bytes. It is empty for PoW blocks.
-    // Modifier V1 is 64 bit while modifier V2 is 256 bit.
-    std::vector<unsigned char> vStakeModifier{};
+    // Modifier V1 is 64 bit while modifier V2 is 256 bit, both are stored inline.
+    prevector<32, unsigned char> vStakeModifier{};
     unsigned int nFlags{0};
 
     //! block header
@@ -225,7 +228,8 @@ public:
     unsigned int nTime{0};
     unsigned int nBits{0};
     unsigned int nNonce{0};
-    uint256 nAccumulatorCheckpoint{};
+    //! Accumulator checkpoint of block versions 4 to 6, shared with the entries that have the same one. NULL if none.
+    const uint256* pAccumulatorCheckpoint{nullptr};
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId{0};
@@ -260,6 +264,15 @@ public:
     uint64_t GetStakeModifierV1() const;
     uint256 GetStakeModifierV2() const;
 
+    // Accumulator checkpoint. Only block versions 4 to 6 have one, the distinct values are pooled.
+    uint256 GetAccumulatorCheckpoint() const;
+    void SetAccumulatorCheckpoint(const uint256& nCheckpoint);
+    //! Number and memory usage of the pooled checkpoints
+    static size_t CountAccumulatorCheckpoints();
+    static size_t DynamicAccumulatorCheckpointsUsage();
+    //! Drop the pool, along with all the block index entries
+    static void ClearAccumulatorCheckpoints();
+
     //! Check whether this block index entry is valid up to the passed validity level.
     bool IsValid(enum BlockStatus nUpTo = BLOCK_VALID_TRANSACTIONS) const;
     //! Raise the validity level of this block index entry.
@@ -272,6 +285,51 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/**
+ * Allocates block index entries next to each other in large chunks, instead of
+ * one heap allocation per entry. Entries keep their address until Clear().
+ */
+class CBlockIndexArena
+{
+public:
+    CBlockIndexArena() : nUsed(CHUNK_ENTRIES) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        if (nUsed == CHUNK_ENTRIES) {
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(sizeof(CBlockIndex) * CHUNK_ENTRIES)));
+            nUsed = 0;
+        }
+        CBlockIndex* pindex = new (vChunks.back() + nUsed) CBlockIndex(std::forward<Args>(args)...);
+        nUsed++;
+        return pindex;
+    }
+
+    //! Destroy all the entries
+    void Clear()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++) {
+            size_t nEntries = (i + 1 == vChunks.size()) ? nUsed : CHUNK_ENTRIES;
+            for (size_t j = 0; j < nEntries; j++)
+                vChunks[i][j].~CBlockIndex();
+            ::operator delete(vChunks[i]);
+        }
+        vChunks.clear();
+        nUsed = CHUNK_ENTRIES;
+    }
+
+private:
+    static const size_t CHUNK_ENTRIES = 4096;
+    std::vector<CBlockIndex*> vChunks;
+    //! Entries used in the last chunk
+    size_t nUsed;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    void operator=(const CBlockIndexArena&);
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 
 // New serialization introduced with 4.0.99
@@ -281,16 +339,23 @@ static const int DBI_SER_VERSION_NO_ZC = 1000000;   // removes mapZerocoinSupply
 class CDiskBlockIndex : public CBlockIndex
 {
 public:
+    //! Not serialized: the hash is the database key of the entry
+    uint256 hashBlock;
     uint256 hashPrev;
+    uint256 nAccumulatorCheckpoint;
 
     CDiskBlockIndex()
     {
+        hashBlock = UINT256_ZERO;
         hashPrev = UINT256_ZERO;
+        nAccumulatorCheckpoint = UINT256_ZERO;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
+        hashBlock = pindex->GetBlockHash();
         hashPrev = (pprev ? pprev->GetBlockHash() : UINT256_ZERO);
+        nAccumulatorCheckpoint = pindex->GetAccumulatorCheckpoint();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -386,16 +451,7 @@ public:
 
     uint256 GetBlockHash() const
     {
-        CBlockHeader block;
-        block.nVersion = nVersion;
-        block.hashPrevBlock = hashPrev;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime = nTime;
-        block.nBits = nBits;
-        block.nNonce = nNonce;
-        if (nVersion > 3 && nVersion < 7)
-            block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
-        return block.GetHash();
+        return hashBlock;
     }
 
 
@@ -416,6 +472,7 @@ class CLegacyBlockIndex : public CBlockIndex
 {
 public:
     std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply{};
+    uint256 nAccumulatorCheckpoint{};
     int64_t nMint = 0;
     uint256 hashNext{};
     uint256 hashPrev{};
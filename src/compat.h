@@ -91,6 +91,12 @@ typedef u_int SOCKET;
 #define THREAD_PRIORITY_ABOVE_NORMAL (-2)
 #endif
 
+// poll() and epoll are not limited to FD_SETSIZE sockets
+#if defined(__linux__)
+#define USE_POLL
+#define USE_EPOLL
+#endif
+
 #if HAVE_DECL_STRNLEN == 0
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
@@ -12,11 +12,12 @@ class CBlockIndex;
 class CCoinsViewCache;
 class CTransaction;
 class CValidationState;
+class CZerocoinSpendCheck;
 
 /** Transaction validation functions */
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false, bool fColdStakingActive=false);
+/** Context-independent validity checks. If pvZerocoinChecks is set, the public zerocoin spend proofs are appended to it instead of verified. */
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false, bool fColdStakingActive=false, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = nullptr);
 
 /**
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
@@ -18,7 +18,14 @@
 #include "utilmoneystr.h"        // for FormatMoney
 
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
+bool CZerocoinSpendCheck::operator()()
+{
+    if (!pspend->VerifyPublicSpend())
+        return error("CZerocoinSpendCheck(): public zerocoin spend of %s did not verify", pspend->spend->getTxOutHash().GetHex());
+    return true;
+}
+
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -40,31 +47,21 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     uint256 hashTxOut = txTemp.GetHash();
 
     bool fValidated = false;
-    const Consensus::Params& consensus = Params().GetConsensus();
     std::set<CBigNum> serials;
     CAmount nTotalRedeemed = 0;
-    for (const CTxIn& txin : tx.vin) {
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxIn& txin = tx.vin[i];
 
         //only check txin that is a zcspend
         bool isPublicSpend = txin.IsZerocoinPublicSpend();
         if (!txin.IsZerocoinSpend() && !isPublicSpend)
             continue;
 
-        libzerocoin::CoinSpend newSpend;
-        CTxOut prevOut;
-        if (isPublicSpend) {
-            if(!GetOutput(txin.prevout.hash, txin.prevout.n, state, prevOut)){
-                return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend prev output not found, prevTx %s, index %d", txin.prevout.hash.GetHex(), txin.prevout.n));
-            }
-            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-            PublicCoinSpend publicSpend(params);
-            if (!ZPWRBModule::parseCoinSpend(txin, tx, prevOut, publicSpend)){
-                return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend parse failed"));
-            }
-            newSpend = publicSpend;
-        } else {
-            newSpend = TxInToZerocoinSpend(txin);
+        CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, i, state);
+        if (!pspend) {
+            return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend parse failed, prevTx %s, index %d", txin.prevout.hash.GetHex(), txin.prevout.n));
         }
+        const libzerocoin::CoinSpend& newSpend = *pspend->spend;
 
         //check that the denomination is valid
         if (newSpend.getDenomination() == libzerocoin::ZQ_ERROR)
@@ -79,9 +76,9 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
             return state.DoS(100, error("Zerocoinspend does not use the same txout that was used in the SoK"));
 
         if (isPublicSpend) {
-            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-            PublicCoinSpend ret(params);
-            if (!ZPWRBModule::validateInput(txin, prevOut, tx, ret)){
+            if (pvChecks) {
+                pvChecks->emplace_back(pspend);
+            } else if (!pspend->VerifyPublicSpend()) {
                 return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend did not verify"));
             }
         }
@@ -12,8 +12,26 @@
 #include "script/interpreter.h"
 #include "zpwrbchain.h"
 
-/** Context-independent validity checks */
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false);
+/** Closure representing the proof verification of one parsed public zerocoin spend input */
+class CZerocoinSpendCheck
+{
+private:
+    CParsedZerocoinSpendRef pspend;
+
+public:
+    CZerocoinSpendCheck() {}
+    explicit CZerocoinSpendCheck(const CParsedZerocoinSpendRef& pspendIn) : pspend(pspendIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        pspend.swap(check.pspend);
+    }
+};
+
+/** Context-independent validity checks. If pvChecks is set, the public spend proofs are appended to it instead of verified. */
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false, std::vector<CZerocoinSpendCheck>* pvChecks = nullptr);
 // Fake Serial attack Range
 bool isBlockBetweenFakeSerialAttackRange(int nHeight);
 // Public coin spend
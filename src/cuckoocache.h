@@ -0,0 +1,171 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace CuckooCache
+{
+/**
+ * Fixed size array of flags packed 8 to a byte. Flags can be set, unset and
+ * read concurrently without locking.
+ */
+class bit_packed_atomic_flags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> mem;
+
+public:
+    bit_packed_atomic_flags() = delete;
+
+    explicit bit_packed_atomic_flags(uint32_t size)
+    {
+        setup(size);
+    }
+
+    /** Resize to hold size flags, all of them set. Not thread safe. */
+    void setup(uint32_t size)
+    {
+        size = (size + 7) / 8;
+        mem.reset(new std::atomic<uint8_t>[size]);
+        for (uint32_t i = 0; i < size; ++i)
+            mem[i].store(0xFF);
+    }
+
+    inline void bit_set(uint32_t s) const
+    {
+        mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed);
+    }
+
+    inline void bit_unset(uint32_t s) const
+    {
+        mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed);
+    }
+
+    inline bool bit_is_set(uint32_t s) const
+    {
+        return (1 << (s & 7)) & mem[s >> 3].load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * A set of small fixed size elements (salted hashes) stored in one flat table,
+ * with each element living in one of HASHES slots picked by its hashes (cuckoo
+ * hashing). The memory use is fixed by setup() and never grows.
+ *
+ * Concurrency: contains() calls may run concurrently with each other, including
+ * the ones that erase. Erasing only flags the slot as reusable, so it never moves
+ * an element under a concurrent reader. insert() and setup() need exclusive access.
+ *
+ * When all the slots of a new element are taken, it displaces the element in one of
+ * them, which moves to another of its own slots, and so on up to depth_limit times.
+ * The element left over at the end is dropped.
+ *
+ * Hash must provide uint32_t operator()(const Element& e, uint8_t n) for n < HASHES,
+ * returning independent and uniformly distributed values.
+ */
+template <typename Element, typename Hash>
+class cache
+{
+public:
+    static const uint8_t HASHES = 8;
+
+private:
+    std::vector<Element> table;
+    uint32_t size;
+    //! Set for the slots that are empty or hold an erased element
+    mutable bit_packed_atomic_flags collection_flags;
+    uint8_t depth_limit;
+    const Hash hash_function;
+
+    /** Slot n of e: maps its n-th hash onto [0, size) without a division. */
+    inline uint32_t slot(const Element& e, uint8_t n) const
+    {
+        return (uint32_t)(((uint64_t)hash_function(e, n) * (uint64_t)size) >> 32);
+    }
+
+public:
+    cache() : table(), size(0), collection_flags(0), depth_limit(0), hash_function() {}
+
+    /** Empty the cache and resize it to hold new_size elements. Returns the number of elements it holds. */
+    uint32_t setup(uint32_t new_size)
+    {
+        size = std::max<uint32_t>(2, new_size);
+        // Displacing more than log2(size) times mostly moves elements in a full table around
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(size)));
+        table.assign(size, Element());
+        collection_flags.setup(size);
+        return size;
+    }
+
+    /** Like setup(), with as many elements as fit in bytes. */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(std::min<size_t>(bytes / sizeof(Element), UINT32_MAX));
+    }
+
+    /** Insert e. If it doesn't fit, e or an element it displaced is dropped. */
+    void insert(Element e)
+    {
+        if (size == 0)
+            return;
+
+        uint32_t locs[HASHES];
+        for (uint8_t n = 0; n < HASHES; ++n)
+            locs[n] = slot(e, n);
+
+        uint32_t last_loc = size; // none yet
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            for (uint8_t n = 0; n < HASHES; ++n) {
+                if (collection_flags.bit_is_set(locs[n])) {
+                    table[locs[n]] = std::move(e);
+                    collection_flags.bit_unset(locs[n]);
+                    return;
+                }
+            }
+
+            // Displace the element of the slot after the one we were displaced from,
+            // so that two elements don't keep swapping each other out.
+            uint8_t i = 0;
+            while (i < HASHES && locs[i] != last_loc)
+                ++i;
+            last_loc = locs[(i + 1) % HASHES];
+            std::swap(table[last_loc], e);
+
+            for (uint8_t n = 0; n < HASHES; ++n)
+                locs[n] = slot(e, n);
+        }
+    }
+
+    /**
+     * Whether e is in the cache. If erase is set, a found element is flagged so
+     * that later inserts may overwrite it. It is still found until they do.
+     */
+    bool contains(const Element& e, const bool erase) const
+    {
+        if (size == 0)
+            return false;
+
+        for (uint8_t n = 0; n < HASHES; ++n) {
+            const uint32_t loc = slot(e, n);
+            if (table[loc] == e) {
+                if (erase)
+                    collection_flags.bit_set(loc);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+} // namespace CuckooCache
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -19,6 +19,8 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "betting/bet.h"
+#include "betting/drawresults.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/zerocoin_verify.h"
@@ -35,6 +37,7 @@
 #include "miner.h"
 #include "net.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "spork.h"
@@ -251,6 +254,10 @@ void PrepareShutdown()
         zerocoinDB = NULL;
         delete pSporkDB;
         pSporkDB = NULL;
+        delete pbetDB;
+        pbetDB = NULL;
+        delete pblockfilterdb;
+        pblockfilterdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -392,6 +399,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), DEFAULT_MAX_REORG_DEPTH));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "pwrbd.pid"));
@@ -403,6 +412,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain compact filters of the scripts of each connected block, used by wallet rescans and the getblockfilter rpc call (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -429,6 +439,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select, epoll", DEFAULT_SOCKETEVENTS));
+#else
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select", DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -451,9 +466,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-custombackupthreshold=<n>", strprintf(_("Number of custom location backups to retain (default: %d)"), DEFAULT_CUSTOMBACKUPTHRESHOLD));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
-    if (GetBoolArg("-help-debug", false))
+    if (GetBoolArg("-help-debug", false)) {
+        strUsage += HelpMessageOpt("-checkwalletbalances", strprintf("Check the cached wallet balances against a full recompute whenever they are read (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"),
                 CURRENCY_UNIT, FormatMoney(CWallet::minTxFee.GetFeePerK())));
+    }
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"), CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
@@ -488,6 +505,10 @@ std::string HelpMessage(HelpMessageMode mode)
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
+        strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-checkpoints", strprintf(_("Only accept block chain matching built-in checkpoints (default: %u)"), 1));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), 100));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf(_("Disable safemode, override a real safe mode event (default: %u)"), 0));
@@ -515,7 +536,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u, maximum: %d)"), DEFAULT_MAX_SIG_CACHE_SIZE, MAX_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for relaying (default: %s)"), CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -534,6 +555,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageGroup(_("Staking options:"));
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), 1));
+    strUsage += HelpMessageOpt("-stakingthreads=<n>", strprintf(_("Set the number of stake kernel scanning threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_STAKEKERNEL_THREADS, DEFAULT_STAKEKERNEL_THREADS));
     strUsage += HelpMessageOpt("-coldstaking=<n>", strprintf(_("Enable cold staking functionality (0-1, default: %u). Disabled if staking=0"), 1));
     strUsage += HelpMessageOpt("-pwrbstake=<n>", strprintf(_("Enable or disable staking functionality for %s inputs (0-1, default: %u)"), CURRENCY_UNIT, 1));
     strUsage += HelpMessageOpt("-zpwrbstake=<n>", strprintf(_("Enable or disable staking functionality for zPWRB inputs (0-1, default: %u)"), 1));
@@ -937,6 +959,8 @@ void InitLogging()
  */
 bool AppInit2()
 {
+    const int64_t nInitStartTime = GetTimeMillis();
+
     // ********************************************************* Step 1: setup
     if (!AppInitBasicSetup())
         return false;
@@ -944,8 +968,20 @@ bool AppInit2()
     // ********************************************************* Step 2: parameter interactions
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
+    std::string strSocketEventsMode = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEventsMode == "select")
+        nSocketEventsMode = SOCKETEVENTS_SELECT;
+#ifdef USE_EPOLL
+    else if (strSocketEventsMode == "epoll")
+        nSocketEventsMode = SOCKETEVENTS_EPOLL;
+#endif
+    else
+        return UIError(strprintf(_("Invalid -socketevents mode: '%s'"), strSocketEventsMode));
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // select() can only watch sockets below FD_SETSIZE
+    if (nSocketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return UIError(_("Not enough file descriptors available."));
@@ -1051,12 +1087,21 @@ bool AppInit2()
 
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    // -maxsigcachesize used to count entries (50000 by default), such values would now ask for gigabytes
+    const int64_t nMaxSigCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    if (nMaxSigCacheSize > MAX_MAX_SIG_CACHE_SIZE)
+        return UIError(strprintf(_("-maxsigcachesize is given in MiB and can't be more than %d"), MAX_MAX_SIG_CACHE_SIZE));
+    if (nMaxSigCacheSize > 4096)
+        UIWarning(strprintf(_("Warning: -maxsigcachesize=%d allocates %d MiB, it is given in MiB and no longer in entries."), nMaxSigCacheSize, nMaxSigCacheSize));
+
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
     // Initialize elliptic curve code
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
+    InitSignatureCache();
+    InitScriptExecutionCache();
 
     // Sanity check
     if (!InitSanityCheck())
@@ -1102,6 +1147,8 @@ bool AppInit2()
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadZerocoinSpendCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1113,6 +1160,7 @@ bool AppInit2()
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    drawResultOracle.Start(scheduler);
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1235,26 +1283,9 @@ bool AppInit2()
 
         uiInterface.InitMessage(_("Verifying past PowerBall results"));
 
-        bool resultsDownloaded = false;
-        // Read results file for past draws
-        try {
-            DownloadResultsFile();
-            resultsDownloaded = true;
-        } catch (const std::exception& e) {
-            LogPrintf("Error downloading the results file: %s\n", e.what());
-        }
-
-        // Read backup results file for past draws
-        try {
-            DownloadResultsFile2();
-            resultsDownloaded = true;
-        } catch (const std::exception& e) {
-            LogPrintf("Error downloading the backup results file: %s\n", e.what());
-        }
-
-        if(!resultsDownloaded) {
-            return UIError(_("Unable to download past draw results for block validation."));
-        }
+        // Fetch the results of past draws; later fetches run in the background
+        if (!drawResultOracle.Refresh())
+            LogPrintf("Unable to download past draw results, bet payout blocks that don't match our results wait until they can be fetched\n");
 
         uiInterface.InitMessage(_("Verifying wallet..."));
 
@@ -1440,9 +1471,13 @@ bool AppInit2()
     }
 #endif
 
+    RegisterValidationInterface(&betPayoutCache);
+    RegisterValidationInterface(&mnodeman);
+
     // ********************************************************* Step 7: load block chain
 
     fReindex = GetBoolArg("-reindex", false);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
 
     // Create blocks directory if it doesn't already exist
     boost::filesystem::create_directories(GetDataDir() / "blocks");
@@ -1481,10 +1516,16 @@ bool AppInit2()
                 delete pblocktree;
                 delete zerocoinDB;
                 delete pSporkDB;
+                delete pbetDB;
+                delete pblockfilterdb;
+                pblockfilterdb = NULL;
 
-                //PWRB specific: zerocoin and spork DB's
+                //PWRB specific: zerocoin, spork and bet DB's
                 zerocoinDB = new CZerocoinDB(0, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
+                pbetDB = new CBetDB(0, false, fReindex);
+                if (fBlockFilterIndex)
+                    pblockfilterdb = new CBlockFilterDB(0, false, fReindex);
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
@@ -1586,6 +1627,20 @@ bool AppInit2()
                     }
                 }
 
+                // Catch the bet index up with the chain tip (e.g. first run, or unclean shutdown)
+                if (!fReindex && chainHeight > consensus.height_last_PoW) {
+                    LOCK(cs_main);
+                    uint256 hashBetBestBlock;
+                    if (!pbetDB->ReadBestBlock(hashBetBestBlock) || hashBetBestBlock != chainActive.Tip()->GetBlockHash()) {
+                        uiInterface.InitMessage(_("Reindexing bet database..."));
+                        std::string strError = ReindexBetDB();
+                        if (strError != "") {
+                            strLoadError = strError;
+                            break;
+                        }
+                    }
+                }
+
                 // Recalculate money supply
                 if (fReindexMoneySupply) {
                     LOCK(cs_main);
@@ -1825,6 +1880,7 @@ bool AppInit2()
                 }
             }
         }
+        pwalletMain->ReindexWalletBets();
         fVerifyingBlocks = false;
 
         if (!zwalletMain->GetMasterSeed().IsNull()) {
@@ -1889,6 +1945,10 @@ bool AppInit2()
         uiInterface.NotifyBlockTip.disconnect(BlockNotifyGenesisWait);
     }
 
+    // Filters of the blocks connected while -blockfilterindex was off are built in the background
+    if (pblockfilterdb)
+        threadGroup.create_thread(&ThreadBlockFilterIndexSync);
+
     // ********************************************************* Step 10: setup layer 2 data
 
     uiInterface.InitMessage(_("Loading masternode cache..."));
@@ -2048,6 +2108,7 @@ bool AppInit2()
 
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
+    LogPrintf(" ready %15dms\n", GetTimeMillis() - nInitStartTime);
 
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
@@ -2060,6 +2121,15 @@ bool AppInit2()
         // StakeMiner thread disabled by default on regtest
         if (GetBoolArg("-staking", !Params().IsRegTestNet())) {
             threadGroup.create_thread(boost::bind(&ThreadStakeMinter));
+
+            // -stakingthreads=0 means autodetect, but nStakeKernelThreads==1 means no concurrency
+            nStakeKernelThreads = GetArg("-stakingthreads", DEFAULT_STAKEKERNEL_THREADS);
+            if (nStakeKernelThreads <= 0)
+                nStakeKernelThreads += boost::thread::hardware_concurrency();
+            nStakeKernelThreads = std::max(1, std::min(nStakeKernelThreads, MAX_STAKEKERNEL_THREADS));
+            LogPrintf("Using %u threads for stake kernel scanning\n", nStakeKernelThreads);
+            for (int i = 0; i < nStakeKernelThreads - 1; i++)
+                threadGroup.create_thread(&ThreadStakeKernelCheck);
         }
     }
 #endif
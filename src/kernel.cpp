@@ -47,24 +47,24 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
     }
     CBlockIndex* pindexFrom = stakeInput->GetIndexFrom();
     nTimeBlockFrom = pindexFrom->nTime;
+    ssPrefix << stakeModifier << nTimeBlockFrom << stakeUniqueness;
+
+    // Get weighted target
+    bnTarget.SetCompact(nBits);
+    bnTarget *= (uint256(stakeValue) / 100);
 }
 
 // Return stake kernel hash
 uint256 CStakeKernel::GetHash() const
 {
-    CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
-    return Hash(ss.begin(), ss.end());
+    CHashWriter ss(ssPrefix);
+    ss << nTime;
+    return ss.GetHash();
 }
 
 // Check that the kernel hash meets the target required
 bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 {
-    // Get weighted target
-    uint256 bnTarget;
-    bnTarget.SetCompact(nBits);
-    bnTarget *= (uint256(stakeValue) / 100);
-
     // Check PoS kernel hash
     const uint256& hashProofOfStake = GetHash();
     const bool res = hashProofOfStake < bnTarget;
@@ -125,6 +125,12 @@ bool LoadStakeInput(const CBlock& block, const CBlockIndex* pindexPrev, std::uni
  * @return      bool            true if stake kernel hash meets target protocol
  */
 bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx)
+{
+    std::unique_ptr<CStakeKernel> stakeKernel;
+    return Stake(pindexPrev, stakeInput, nBits, nTimeTx, stakeKernel);
+}
+
+bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, std::unique_ptr<CStakeKernel>& stakeKernel)
 {
     // Double check stake input contextual checks
     const int nHeightTx = pindexPrev->nHeight + 1;
@@ -136,8 +142,12 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
     if (nTimeTx <= pindexPrev->nTime && !fRegTest) return false;
 
     // Verify Proof Of Stake
-    CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
-    return stakeKernel.CheckKernelHash(true);
+    if (!stakeKernel) {
+        stakeKernel.reset(new CStakeKernel(pindexPrev, stakeInput, nBits, nTimeTx));
+    } else {
+        stakeKernel->SetTime(nTimeTx);
+    }
+    return stakeKernel->CheckKernelHash(true);
 }
 
 
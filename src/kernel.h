@@ -10,6 +10,7 @@
 #ifndef PWRB_KERNEL_H
 #define PWRB_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 #include "stakeinput.h"
 
@@ -25,6 +26,9 @@ public:
      */
     CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int nTimeTx);
 
+    // Move the kernel to another time slot on top of the same parent block
+    void SetTime(int nTimeTx) { nTime = nTimeTx; }
+
     // Return stake kernel hash
     uint256 GetHash() const;
 
@@ -37,9 +41,12 @@ private:
     int nTimeBlockFrom{0};
     CDataStream stakeUniqueness{CDataStream(SER_GETHASH, 0)};
     int nTime{0};
+    // hasher fed with everything but nTime, shared by all the time slots
+    CHashWriter ssPrefix{CHashWriter(SER_GETHASH, 0)};
     // hash target
     unsigned int nBits{0};     // difficulty for the target
     CAmount stakeValue{0};     // target multiplier
+    uint256 bnTarget;          // weighted target
 };
 
 /* PoS Validation */
@@ -55,6 +62,19 @@ private:
  */
 bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx);
 
+/*
+ * Stake                Same as above, keeping the kernel for the next time slots on top of pindexPrev
+ *
+ * @param[in]   pindexPrev      index of the parent block of the block being staked
+ * @param[in]   stakeInput      input for the coinstake
+ * @param[in]   nBits           target difficulty bits
+ * @param[in]   nTimeTx         new blocktime
+ * @param[in,out] stakeKernel   kernel of stakeInput on top of pindexPrev with target nBits
+ *                              (built if null, only the time slot is hashed otherwise)
+ * @return      bool            true if stake kernel hash meets target protocol
+ */
+bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, int64_t& nTimeTx, std::unique_ptr<CStakeKernel>& stakeKernel);
+
 /*
  * CheckProofOfStake    Check if block has valid proof of stake
  *
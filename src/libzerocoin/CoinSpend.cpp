@@ -67,7 +67,7 @@ bool CoinSpend::HasValidSignature() const
     return pubkey.Verify(signatureHash(), vchSig);
 }
 
-CBigNum CoinSpend::CalculateValidSerial(ZerocoinParams* params)
+CBigNum CoinSpend::CalculateValidSerial(ZerocoinParams* params) const
 {
     CBigNum bnSerial = coinSerialNumber;
     bnSerial = bnSerial % params->coinCommitmentGroup.groupOrder;
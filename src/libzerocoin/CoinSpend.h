@@ -122,7 +122,7 @@ public:
     void setDenom(libzerocoin::CoinDenomination denom) { this->denomination = denom; }
     void setPubKey(CPubKey pkey, bool fUpdateSerial = false);
 
-    CBigNum CalculateValidSerial(ZerocoinParams* params);
+    CBigNum CalculateValidSerial(ZerocoinParams* params) const;
     std::string ToString() const;
 
     ADD_SERIALIZE_METHODS;
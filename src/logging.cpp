@@ -127,6 +127,7 @@ const CLogCategoryDesc LogCategories[] = {
         {BCLog::MASTERNODE,     "masternode"},
         {BCLog::MNBUDGET,       "mnbudget"},
         {BCLog::LEGACYZC,       "zero"},
+        {BCLog::BETTING,        "betting"},
         {BCLog::ALL,            "1"},
         {BCLog::ALL,            "all"},
 };
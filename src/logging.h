@@ -64,6 +64,7 @@ namespace BCLog {
         MASTERNODE  = (1 << 22),
         MNBUDGET    = (1 << 23),
         LEGACYZC    = (1 << 24),
+        BETTING     = (1 << 25),
         ALL         = ~(uint32_t)0,
     };
 
@@ -15,6 +15,8 @@
 #include "addrman.h"
 #include "amount.h"
 #include "betting/bet.h"
+#include "betting/drawresults.h"
+#include "blockfilter.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -24,6 +26,8 @@
 #include "consensus/validation.h"
 #include "consensus/zerocoin_verify.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -81,6 +85,8 @@
 RecursiveMutex cs_main;
 
 BlockMap mapBlockIndex;
+//! Storage of the mapBlockIndex entries
+static CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
@@ -95,6 +101,7 @@ int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
 bool fTxIndex = true;
+bool fBlockFilterIndex = DEFAULT_BLOCKFILTERINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -631,6 +638,8 @@ CCoinsViewCache* pcoinsTip = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
+CBetDB* pbetDB = NULL;
+CBlockFilterDB* pblockfilterdb = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -958,6 +967,22 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+/** Expire and trim the mempool, the wallets are told about the transactions that left it except hashAccepted */
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age, const uint256& hashAccepted)
+{
+    std::list<CTransaction> removed;
+    int expired = pool.Expire(GetTime() - age, &removed);
+    if (expired != 0)
+        LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit, &removed);
+
+    for (const CTransaction& tx : removed) {
+        if (tx.GetHash() != hashAccepted)
+            SyncWithWallets(tx, NULL);
+    }
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
@@ -1046,25 +1071,25 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                         __func__, tx.GetHash().GetHex(), nHeightTx), REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
             //Check for double spending of serial #'s
-            for (const CTxIn& txIn : tx.vin) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 // Only allow for public zc spends inputs
-                if (!txIn.IsZerocoinPublicSpend())
+                if (!tx.vin[i].IsZerocoinPublicSpend())
                     return state.Invalid(error("%s: failed for tx %s, every input must be a zcpublicspend",
                             __func__, tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-zpwrb");
 
-                libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                PublicCoinSpend publicSpend(params);
-                if (!ZPWRBModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
+                CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, i, state);
+                if (!pspend){
                     return false;
                 }
-                if (!ContextualCheckZerocoinSpend(tx, &publicSpend, chainHeight, UINT256_ZERO))
+                const libzerocoin::CoinSpend* publicSpend = pspend->spend.get();
+                if (!ContextualCheckZerocoinSpend(tx, publicSpend, chainHeight, UINT256_ZERO))
                     return state.Invalid(error("%s: ContextualCheckZerocoinSpend failed for tx %s",
                             __func__, tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-zpwrb");
 
                 // Check that the version matches the one enforced with SPORK_18
-                if (!CheckPublicCoinSpendVersion(publicSpend.getVersion())) {
+                if (!CheckPublicCoinSpendVersion(publicSpend->getVersion())) {
                     return state.Invalid(error("%s : Public Zerocoin spend version %d not accepted. must be version %d.",
-                            __func__, publicSpend.getVersion(), CurrentPublicCoinSpendVersion()), REJECT_INVALID, "bad-txns-invalid-zpwrb");
+                            __func__, publicSpend->getVersion(), CurrentPublicCoinSpendVersion()), REJECT_INVALID, "bad-txns-invalid-zpwrb");
                 }
 
             }
@@ -1135,7 +1160,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = 0;
         if (!hasZcSpendInputs)
-            view.GetPriority(tx, chainHeight);
+            dPriority = view.GetPriority(tx, chainHeight);
 
         CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainHeight);
         unsigned int nSize = entry.GetTxSize();
@@ -1147,6 +1172,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 return state.DoS(0, error("%s : not enough fees %s, %d < %d",
                         __func__, hash.ToString(), nFees, txMinFee), REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // A full mempool raises the bar above the transactions it evicted, so that they don't come right back
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee && !hasZcSpendInputs)
+                return state.DoS(0, error("%s : mempool min fee not met %s, %d < %d",
+                        __func__, hash.ToString(), nFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (!hasZcSpendInputs && GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainHeight + 1))) {
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1188,6 +1219,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                     __func__, hash.ToString(), nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
         }
 
+        // Calculate in-mempool ancestors, up to a limit. Long unconfirmed chains make every
+        // mempool update walk the whole package, so they are refused before the script checks.
+        {
+            LOCK(pool.cs);
+            CTxMemPool::setEntries setAncestors;
+            size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+            size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+            size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+            size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+            std::string errString;
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString))
+                return state.DoS(0, error("%s : too long mempool chain %s, %s", __func__, hash.ToString(), errString), REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         bool fCLTVIsActivated = (chainHeight >= consensus.height_start_BIP65);
 
         // Check against previous transactions
@@ -1216,8 +1261,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                     __func__, hash.ToString());
         }
 
+        // Check again against the flags of the next block, so that ConnectBlock can skip the scripts
+        // of this transaction. Its signatures are all in the signature cache by now.
+        if (!CheckInputs(tx, state, view, true, GetBlockScriptFlags(chainHeight), true, NULL, true)) {
+            return error("%s : BUG! PLEASE REPORT THIS! ConnectInputs failed against block but not STANDARD flags %s",
+                    __func__, hash.ToString());
+        }
+
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // Trim the mempool, the transaction itself may have the lowest fee rate
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60, hash);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, nullptr);
@@ -1794,22 +1851,17 @@ void AddInvalidSpendsToMap(const CBlock& block)
             continue;
 
         //Check all zerocoinspends for bad serials
-        for (const CTxIn& in : tx.vin) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CTxIn& in = tx.vin[i];
             bool isPublicSpend = in.IsZerocoinPublicSpend();
             if (in.IsZerocoinSpend() || isPublicSpend) {
 
-                libzerocoin::CoinSpend* spend;
-                if (isPublicSpend) {
-                    PublicCoinSpend publicSpend(params);
-                    CValidationState state;
-                    if (!ZPWRBModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                        throw std::runtime_error("Failed to parse public spend");
-                    }
-                    spend = &publicSpend;
-                } else {
-                    libzerocoin::CoinSpend spendObj = TxInToZerocoinSpend(in);
-                    spend = &spendObj;
+                CValidationState state;
+                CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, i, state);
+                if (!pspend) {
+                    throw std::runtime_error("Failed to parse public spend");
                 }
+                const libzerocoin::CoinSpend* spend = pspend->spend.get();
 
                 //If serial is not valid, mark all outputs as bad
                 if (!spend->HasValidSerial(params)) {
@@ -1851,7 +1903,33 @@ bool ValidOutPoint(const COutPoint& out, int nHeight)
     return !isInvalid;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+namespace {
+//! Salted hashes of (txid, script flags) of the transactions whose scripts all passed, protected by cs_main
+CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+uint256 scriptExecutionCacheNonce;
+uint64_t nScriptExecutionCacheHits = 0;
+}
+
+void InitScriptExecutionCache()
+{
+    LOCK(cs_main);
+    GetRandBytes(scriptExecutionCacheNonce.begin(), 32);
+    // The signature cache gets the other half
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+              (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
+}
+
+unsigned int GetBlockScriptFlags(int nTipHeight)
+{
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (nTipHeight >= Params().GetConsensus().height_start_BIP65)
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return flags;
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, bool cacheFullScriptStore)
 {
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
         if (pvChecks)
@@ -1913,6 +1991,18 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // The scripts of a transaction only depend on the outputs it spends, which its
+            // txid commits to, and on the flags: a transaction that passed with the same flags
+            // (usually when it entered the mempool) passes again. The entry is flagged for
+            // reuse when it's found while connecting a block.
+            AssertLockHeld(cs_main);
+            uint256 hashCacheEntry;
+            CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                nScriptExecutionCacheHits++;
+                return true;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
@@ -1946,6 +2036,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // Queued checks haven't run yet, only remember the ones that passed here
+            if (cacheFullScriptStore && !pvChecks)
+                scriptExecutionCache.insert(hashCacheEntry);
         }
     }
 
@@ -1978,11 +2072,11 @@ void DataBaseAccChecksum(CBlockIndex* pindex, bool fWrite)
     if (!pindex ||
             pindex->nHeight < consensus.height_start_ZC_SerialsV2 ||
             pindex->nHeight > consensus.height_last_ZC_AccumCheckpoint ||
-            pindex->nAccumulatorCheckpoint == pindex->pprev->nAccumulatorCheckpoint)
+            pindex->GetAccumulatorCheckpoint() == pindex->pprev->GetAccumulatorCheckpoint())
         return;
 
-    uint256 accCurr = pindex->nAccumulatorCheckpoint;
-    uint256 accPrev = pindex->pprev->nAccumulatorCheckpoint;
+    uint256 accCurr = pindex->GetAccumulatorCheckpoint();
+    uint256 accPrev = pindex->pprev->GetAccumulatorCheckpoint();
     // add/remove changed checksums to/from DB
     for (int i = (int)libzerocoin::zerocoinDenomList.size()-1; i >= 0; i--) {
         const uint32_t& nChecksum = accCurr.Get32();
@@ -1996,7 +2090,7 @@ void DataBaseAccChecksum(CBlockIndex* pindex, bool fWrite)
     }
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fBetIndex)
 {
     AssertLockHeld(cs_main);
 
@@ -2025,6 +2119,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (!UpdateZPWRBSupplyDisconnect(block, pindex))
         return error("%s: Failed to calculate new zPWRB supply", __func__);
 
+    // Unwind the lotto bet index
+    if (fBetIndex && !pbetDB->EraseBlockBets(pindex, GetBlockBetIndexKeys(block, pindex->nHeight)))
+        return error("%s: Failed to erase lotto bets from the bet index", __func__);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2037,23 +2135,17 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             libzerocoin::ZerocoinParams *params = Params().GetConsensus().Zerocoin_Params(false);
             if (tx.HasZerocoinSpendInputs()) {
                 //erase all zerocoinspends in this transaction
-                for (const CTxIn &txin : tx.vin) {
+                for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                    const CTxIn& txin = tx.vin[nIn];
                     bool isPublicSpend = txin.IsZerocoinPublicSpend();
                     if (txin.scriptSig.IsZerocoinSpend() || isPublicSpend) {
-                        CBigNum serial;
-                        if (isPublicSpend) {
-                            PublicCoinSpend publicSpend(params);
-                            CValidationState state;
-                            if (!ZPWRBModule::ParseZerocoinPublicSpend(txin, tx, state, publicSpend)) {
-                                return error("Failed to parse public spend");
-                            }
-                            serial = publicSpend.getCoinSerialNumber();
-                            nValueIn += publicSpend.getDenomination() * COIN;
-                        } else {
-                            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
-                            serial = spend.getCoinSerialNumber();
-                            nValueIn += spend.getDenomination() * COIN;
+                        CValidationState state;
+                        CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, nIn, state);
+                        if (!pspend) {
+                            return error("Failed to parse public spend");
                         }
+                        const CBigNum& serial = pspend->spend->getCoinSerialNumber();
+                        nValueIn += pspend->spend->getDenomination() * COIN;
 
                         if (!zerocoinDB->EraseCoinSpend(serial))
                             return error("failed to erase spent zerocoin in block");
@@ -2191,6 +2283,22 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
+/** Add the filter of a connected block to the block filter index. The filter header
+ *  chain starts at block 1, the genesis block has no filter. */
+static bool WriteBlockFilter(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (pblockfilterdb->HaveFilter(pindex->GetBlockHash()))
+        return true;
+
+    uint256 hashPrevHeader;
+    if (pindex->pprev)
+        pblockfilterdb->ReadFilterHeader(pindex->pprev->GetBlockHash(), hashPrevHeader);
+
+    BlockFilter filter(block, blockundo);
+    return pblockfilterdb->WriteFilter(filter, filter.ComputeHeader(hashPrevHeader));
+}
+
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck()
@@ -2199,13 +2307,24 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/** Public zerocoin spend proofs take milliseconds each, so hand them out in small batches */
+static CCheckQueue<CZerocoinSpendCheck> zerocoincheckqueue(4);
+
+void ThreadZerocoinSpendCheck()
+{
+    util::ThreadRename("pwrb-zcspendch");
+    zerocoincheckqueue.Thread();
+}
+
+static std::atomic<int64_t> nTimeZerocoinVerify{0};
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, bool fBetIndex)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2246,15 +2365,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
-    // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
-    bool fCLTVIsActivated = false;
-    if (fScriptChecks && pindex->pprev) {
-        fCLTVIsActivated = pindex->pprev->nHeight >= consensus.height_start_BIP65;
-    }
+    const unsigned int nScriptFlags = GetBlockScriptFlags(pindex->nHeight - 1);
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
+    const CSignatureCacheStats sigCacheStart = GetSignatureCacheStats();
+    const uint64_t nScriptCacheHitsStart = nScriptExecutionCacheHits;
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
@@ -2262,6 +2379,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpends;
     std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
+    std::vector<std::pair<CBetIndexKey, CBetIndexEntry> > vBets;
+    std::vector<CTxOut> vBetsPaid;
     vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -2325,7 +2444,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             //Check for double spending of serial #'s
             std::set<CBigNum> setSerials;
-            for (const CTxIn& txIn : tx.vin) {
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                const CTxIn& txIn = tx.vin[nIn];
                 bool isPublicSpend = txIn.IsZerocoinPublicSpend();
                 bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
                 if (!isPrivZerocoinSpend && !isPublicSpend)
@@ -2336,25 +2456,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     return false;
                 }
 
-                if (isPublicSpend) {
-                    libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                    PublicCoinSpend publicSpend(params);
-                    if (!ZPWRBModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
-                        return false;
-                    }
-                    nValueIn += publicSpend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(std::make_pair(publicSpend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
-                } else {
-                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                    nValueIn += spend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(std::make_pair(spend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &spend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, nIn, state);
+                if (!pspend){
+                    return false;
                 }
+                const libzerocoin::CoinSpend* spend = pspend->spend.get();
+                nValueIn += spend->getDenomination() * COIN;
+                //queue for db write after the 'justcheck' section has concluded
+                vSpends.emplace_back(std::make_pair(*spend, tx.GetHash()));
+                if (!ContextualCheckZerocoinSpend(tx, spend, pindex->nHeight, hashBlock))
+                    return state.DoS(100, error("%s: failed to add block %s with invalid %s", __func__, tx.GetHash().GetHex(),
+                                                isPublicSpend ? "public zc spend" : "zerocoinspend"), REJECT_INVALID);
             }
 
         } else if (!tx.IsCoinBase()) {
@@ -2382,23 +2494,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
-            if (fCLTVIsActivated)
-                flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, nScriptFlags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
         }
         nValueOut += tx.GetValueOut();
 
-        std::string scriptPubKey;
         for (const CTxOut& out : tx.vout) {
-            scriptPubKey = ScriptToAsmStr(out.scriptPubKey);
-
-            if(scriptPubKey.length() > 0 && strncmp(scriptPubKey.c_str(), "OP_RETURN", 9) == 0){
+            if (!out.scriptPubKey.empty() && out.scriptPubKey[0] == OP_RETURN)
                 nValueBet += out.nValue;
-            }
+        }
+
+        // Index the lotto bets while the outputs spent by tx are still in the view
+        if (pindex->nHeight > last_pow_block) {
+            const CTxOut* pprevout = NULL;
+            if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs())
+                pprevout = &view.GetOutputFor(tx.vin[0]);
+            IndexBetTransaction(tx, i, pindex, pprevout, vBets, vBetsPaid);
         }
 
         CTxUndo undoDummy;
@@ -2427,26 +2539,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<CBetOut> vExpectedLottoPayouts;
 
     // Get the PL and CG bet payout TX's so we can calculate the winning bet vector which is used to mint coins and payout bets.
-    vExpectedLottoPayouts = GetBetPayouts(pindex->nHeight);
+    std::shared_ptr<const CDrawResults> drawResults = drawResultOracle.GetSnapshot();
+    vExpectedLottoPayouts = GetBetPayouts(pindex->nHeight, *drawResults);
 
     // Get the total amount of PWR that needs to be minted to payout all winning bets.
-    CAmount nExpectedMint2 = nExpectedMint;
     nExpectedMint += GetBlockPayouts(vExpectedLottoPayouts);
 
     if (!IsBlockPayoutsValid(vExpectedLottoPayouts, block, pindex->nHeight) && vExpectedLottoPayouts.size() > 0) {
         if (Params().NetworkID() == CBaseChainParams::TESTNET) {
                 LogPrintf("ConnectBlock() - Skipping validation of bet payouts on testnet subset : Bet payout TX's don't match up with block payout TX's at block %i\n", pindex->nHeight);
-        } else  {
-            DownloadResultsFile();
-            DownloadResultsFile2();
-            MilliSleep(180000);
-            vExpectedLottoPayouts.clear();
-            vExpectedLottoPayouts = GetBetPayouts(pindex->nHeight);
-            nExpectedMint = nExpectedMint2 + GetBlockPayouts(vExpectedLottoPayouts);
-            if (!IsBlockPayoutsValid(vExpectedLottoPayouts, block, pindex->nHeight) && vExpectedLottoPayouts.size() > 0) {
-                return state.DoS(100, error("ConnectBlock() : Bet payout TX's don't match up with block payout TX's %i ", pindex->nHeight), REJECT_INVALID, "bad-cb-payout");
-            }
+        } else if (drawResultOracle.ParkBlock(hashBlock, *drawResults)) {
+            // Our draw results may be stale: the block is retried once they have been refreshed
+            // in the background, instead of stalling validation while holding cs_main. This is
+            // not a rejection, the block is neither marked invalid nor its peer punished.
+            return state.Error(strprintf("%s : bet payouts of block %i pending draw results", __func__, pindex->nHeight));
+        } else {
+            return state.DoS(100, error("ConnectBlock() : Bet payout TX's don't match up with block payout TX's %i ", pindex->nHeight), REJECT_INVALID, "bad-cb-payout");
         }
+    } else if (vExpectedLottoPayouts.size() > 0) {
+        drawResultOracle.UnparkBlock(hashBlock);
     }
 
     LogPrintf("ConnectBlock() - Expected Mint After Adding Bets to be Paid: %i\n", nExpectedMint);
@@ -2466,6 +2577,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
+    if (LogAcceptCategory(BCLog::BENCH)) {
+        // Transactions seen in the mempool should mostly skip their scripts, or at least hit the signature cache
+        const CSignatureCacheStats sigCacheEnd = GetSignatureCacheStats();
+        LogPrint(BCLog::BENCH, "      - Script cache: %u txs skipped, signature cache: %u hits, %u misses\n", nScriptExecutionCacheHits - nScriptCacheHitsStart,
+                 sigCacheEnd.nHits - sigCacheStart.nHits, sigCacheEnd.nMisses - sigCacheStart.nMisses);
+    }
 
     //IMPORTANT NOTE: Nothing before this point should actually store to disk (or even memory)
     if (fJustCheck)
@@ -2489,6 +2606,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
+    // Until the index is synced, the filters are written by ThreadBlockFilterIndexSync, in chain order
+    if (pblockfilterdb && pblockfilterdb->IsSynced() && !WriteBlockFilter(block, blockundo, pindex))
+        return AbortNode(state, "Failed to write block filter");
+
     //Record zPWRB serials
     if (pwalletMain) {
         std::set<uint256> setAddedTx;
@@ -2525,6 +2646,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!vMints.empty() && !zerocoinDB->WriteCoinMintBatch(vMints))
         return AbortNode(state, "Failed to record new mints to database");
 
+    if (fBetIndex && !pbetDB->WriteBlockBets(pindex, vBets, vBetsPaid))
+        return AbortNode(state, "Failed to record lotto bets to database");
+
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
@@ -2758,22 +2882,27 @@ bool static DisconnectTip(CValidationState& state)
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
         return false;
     // Resurrect mempool transactions from the disconnected block.
+    std::list<CTransaction> removed;
     for (const CTransaction& tx : block.vtx) {
         // ignore validation errors in resurrected transactions
-        std::list<CTransaction> removed;
         CValidationState stateDummy;
         if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
             mempool.remove(tx, removed, true);
     }
-    mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
+    mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight, removed);
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
-    // Let wallets know transactions went from 1-confirmed to
+    // Let wallets know about the transactions that left the mempool with it...
+    for (const CTransaction& tx : removed) {
+        SyncWithWallets(tx, NULL);
+    }
+    // ... and about the ones that went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const CTransaction& tx : block.vtx) {
         SyncWithWallets(tx, NULL);
     }
+    GetMainSignals().BlockDisconnected(block, pindexDelete);
     return true;
 }
 
@@ -2927,6 +3056,9 @@ bool DisconnectBlockAndInputs(CValidationState& state, CTransaction txLock)
     //remove anything conflicting in the memory pool
     std::list<CTransaction> txConflicted;
     mempool.removeConflicts(txLock, txConflicted);
+    for (const CTransaction& tx : txConflicted) {
+        SyncWithWallets(tx, NULL);
+    }
 
 
     // List of what to disconnect (typically nothing)
@@ -3285,8 +3417,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3647,6 +3778,8 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     std::vector<CBigNum> vBlockSerials;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     int blockHeight = chainActive.Height() + 1;
+    // The public zerocoin spend proofs are collected and verified on the zerocoin check threads at the end
+    std::vector<CZerocoinSpendCheck> vZerocoinChecks;
     for (const CTransaction& tx : block.vtx) {
         if (!CheckTransaction(
                 tx,
@@ -3654,30 +3787,26 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                 blockHeight >= Params().GetConsensus().height_start_ZC_SerialRangeCheck,
                 state,
                 isBlockBetweenFakeSerialAttackRange(blockHeight),
-                fColdStakingActive
+                fColdStakingActive,
+                nScriptCheckThreads ? &vZerocoinChecks : nullptr
         ))
             return error("%s : CheckTransaction failed", __func__);
 
         // double check that there are no double spent zPWRB spends in this block
         if (tx.HasZerocoinSpendInputs()) {
-            for (const CTxIn& txIn : tx.vin) {
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                const CTxIn& txIn = tx.vin[nIn];
                 bool isPublicSpend = txIn.IsZerocoinPublicSpend();
                 if (txIn.IsZerocoinSpend() || isPublicSpend) {
-                    libzerocoin::CoinSpend spend;
-                    if (isPublicSpend) {
-                        libzerocoin::ZerocoinParams* params = Params().GetConsensus().Zerocoin_Params(false);
-                        PublicCoinSpend publicSpend(params);
-                        if (!ZPWRBModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
-                            return false;
-                        }
-                        spend = publicSpend;
-                        // check that the version matches the one enforced with SPORK_18 (don't ban if it fails)
-                        if (!IsInitialBlockDownload() && !CheckPublicCoinSpendVersion(spend.getVersion())) {
-                            return state.DoS(0, error("%s : Public Zerocoin spend version %d not accepted. must be version %d.",
-                                    __func__, spend.getVersion(), CurrentPublicCoinSpendVersion()), REJECT_INVALID, "bad-zcspend-version");
-                        }
-                    } else {
-                        spend = TxInToZerocoinSpend(txIn);
+                    CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, nIn, state);
+                    if (!pspend){
+                        return false;
+                    }
+                    const libzerocoin::CoinSpend& spend = *pspend->spend;
+                    // check that the version matches the one enforced with SPORK_18 (don't ban if it fails)
+                    if (isPublicSpend && !IsInitialBlockDownload() && !CheckPublicCoinSpendVersion(spend.getVersion())) {
+                        return state.DoS(0, error("%s : Public Zerocoin spend version %d not accepted. must be version %d.",
+                                __func__, spend.getVersion(), CurrentPublicCoinSpendVersion()), REJECT_INVALID, "bad-zcspend-version");
                     }
                     if (std::count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
                         return state.DoS(100, error("%s : Double spending of zPWRB serial %s in block\n Block: %s",
@@ -3688,6 +3817,21 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    if (!vZerocoinChecks.empty()) {
+        // Only the proof verification runs under the queue control: the checks above take cs_main,
+        // which a caller of CheckBlock may hold while it waits for the queue.
+        const unsigned int nZerocoinChecks = vZerocoinChecks.size();
+        int64_t nTimeZerocoinStart = GetTimeMicros();
+        CCheckQueueControl<CZerocoinSpendCheck> control(&zerocoincheckqueue);
+        control.Add(vZerocoinChecks);
+        if (!control.Wait())
+            return state.DoS(100, error("%s : CheckTransaction failed, invalid zerocoin spend", __func__));
+        int64_t nTimeZerocoin = GetTimeMicros() - nTimeZerocoinStart;
+        nTimeZerocoinVerify += nTimeZerocoin;
+        LogPrint(BCLog::BENCH, "    - Verify %u zerocoin spends: %.2fms (%.3fms/spend) [%.2fs]\n", nZerocoinChecks, 0.001 * nTimeZerocoin,
+                 0.001 * nTimeZerocoin / nZerocoinChecks, nTimeZerocoinVerify * 0.000001);
+    }
+
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx) {
         nSigOps += GetLegacySigOpCount(tx);
@@ -4005,7 +4149,8 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
 
         std::vector<CBigNum> inBlockSerials;
         for (const CTransaction& tx : block.vtx) {
-            for (const CTxIn& in: tx.vin) {
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                const CTxIn& in = tx.vin[nIn];
                 if(nHeight >= Params().GetConsensus().height_start_ZC) {
                     bool isPublicSpend = in.IsZerocoinPublicSpend();
                     bool isPrivZerocoinSpend = in.IsZerocoinSpend();
@@ -4016,17 +4161,11 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                             return false;
                         }
 
-                        libzerocoin::CoinSpend spend;
-                        if (isPublicSpend) {
-                            libzerocoin::ZerocoinParams* params = Params().GetConsensus().Zerocoin_Params(false);
-                            PublicCoinSpend publicSpend(params);
-                            if (!ZPWRBModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                return false;
-                            }
-                            spend = publicSpend;
-                        } else {
-                            spend = TxInToZerocoinSpend(in);
+                        CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, nIn, state);
+                        if (!pspend){
+                            return false;
                         }
+                        const libzerocoin::CoinSpend& spend = *pspend->spend;
                         // Check for serials double spending in the same block
                         if (std::find(inBlockSerials.begin(), inBlockSerials.end(), spend.getCoinSerialNumber()) !=
                             inBlockSerials.end()) {
@@ -4392,6 +4531,66 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly)
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+FILE* OpenFilterFile(const CDiskBlockPos& pos, bool fReadOnly)
+{
+    return OpenDiskFile(pos, "fltr", fReadOnly);
+}
+
+void ThreadBlockFilterIndexSync()
+{
+    util::ThreadRename("pwrb-blockfilter");
+
+    // Resume after the last filter written, on the active chain
+    const CBlockIndex* pindexLast = NULL;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pblockfilterdb->ReadBestBlock(hashBest) && mapBlockIndex.count(hashBest))
+            pindexLast = chainActive.FindFork(mapBlockIndex[hashBest]);
+        if (!pindexLast)
+            pindexLast = chainActive.Genesis();
+        LogPrintf("%s : building the block filters from height %d to %d\n", __func__,
+                  pindexLast->nHeight + 1, chainActive.Height());
+    }
+
+    int64_t nTimeStart = GetTimeMillis();
+    int nBlocks = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return;
+
+        LOCK(cs_main);
+        // A reorg since the last filter continues from the fork point
+        if (!chainActive.Contains(pindexLast))
+            pindexLast = chainActive.FindFork(pindexLast);
+        CBlockIndex* pindex = chainActive.Next(pindexLast);
+        if (!pindex) {
+            // Caught up with the tip, ConnectBlock writes the filters from now on
+            pblockfilterdb->SetSynced();
+            LogPrintf("%s : %d block filters built in %dms, the block filter index is synced at height %d\n", __func__,
+                      nBlocks, GetTimeMillis() - nTimeStart, pindexLast->nHeight);
+            return;
+        }
+
+        if (!pblockfilterdb->HaveFilter(pindex->GetBlockHash())) {
+            CBlock block;
+            CBlockUndo blockundo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!ReadBlockFromDisk(block, pindex) || pos.IsNull() || !blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash())) {
+                LogPrintf("%s : failed to read block %s, the block filter index stays unsynced\n", __func__, pindex->GetBlockHash().GetHex());
+                return;
+            }
+            if (!WriteBlockFilter(block, blockundo, pindex)) {
+                LogPrintf("%s : failed to write the filter of block %s, the block filter index stays unsynced\n", __func__, pindex->GetBlockHash().GetHex());
+                return;
+            }
+            nBlocks++;
+        }
+        pindexLast = pindex;
+    }
+}
+
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -4408,9 +4607,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -4418,21 +4615,73 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+/** Recompute the hash of every nThreads-th sampled entry, starting at nOffset */
+static void CheckBlockIndexHashesPart(const std::vector<const CBlockIndex*>& vSample, int nOffset, int nThreads, std::atomic<int>& nMismatches)
+{
+    for (size_t i = nOffset; i < vSample.size(); i += nThreads) {
+        const CBlockIndex* pindex = vSample[i];
+        if (pindex->GetBlockHeader().GetHash() != pindex->GetBlockHash()) {
+            LogPrintf("%s : block index entry %s at height %d doesn't match its header\n", __func__,
+                      pindex->GetBlockHash().GetHex(), pindex->nHeight);
+            nMismatches++;
+        }
+    }
+}
+
+/**
+ * The block index is loaded with the hashes of its database keys. Re-check
+ * a random sample of them against their headers, on all cores.
+ */
+static bool CheckBlockIndexHashes()
+{
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> vSample;
+    vSample.reserve(std::min(mapBlockIndex.size(), (size_t)BLOCK_INDEX_HASH_CHECK_SAMPLE));
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        if (mapBlockIndex.size() <= BLOCK_INDEX_HASH_CHECK_SAMPLE || GetRand(mapBlockIndex.size()) < BLOCK_INDEX_HASH_CHECK_SAMPLE)
+            vSample.push_back(item.second);
+    }
+
+    int nThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+    std::atomic<int> nMismatches(0);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CheckBlockIndexHashesPart, boost::cref(vSample), i, nThreads, boost::ref(nMismatches)));
+    threads.join_all();
+
+    LogPrintf("%s : checked %u of %u block index hashes in %dms\n", __func__, vSample.size(), mapBlockIndex.size(), GetTimeMillis() - nStart);
+    if (nMismatches > 0)
+        return error("%s : %d block index entries don't match their headers", __func__, (int)nMismatches);
+    return true;
+}
+
 bool static LoadBlockIndexDB(std::string& strError)
 {
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
 
+    if (fCheckBlockIndex && !CheckBlockIndexHashes())
+        return false;
+
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
+    size_t nWithCheckpoint = 0;
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
         CBlockIndex* pindex = item.second;
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        if (pindex->pAccumulatorCheckpoint)
+            nWithCheckpoint++;
     }
     std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // Accumulator checkpoints cost a pointer per entry plus the pool, instead of a copy in every entry
+    LogPrintf("%s : %u block index entries of %u bytes, %u with an accumulator checkpoint: %u pooled in %ukB, %ukB as a copy per entry\n",
+              __func__, mapBlockIndex.size(), sizeof(CBlockIndex), nWithCheckpoint, CBlockIndex::CountAccumulatorCheckpoints(),
+              (mapBlockIndex.size() * sizeof(const uint256*) + CBlockIndex::DynamicAccumulatorCheckpointsUsage()) / 1024,
+              mapBlockIndex.size() * sizeof(uint256) / 1024);
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
@@ -4578,10 +4827,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
                     return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks,
+        // the bet index stays at the tip like the coins database
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, false))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -4606,7 +4856,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex))
                 return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            if (!ConnectBlock(block, state, pindex, coins, false))
+            if (!ConnectBlock(block, state, pindex, coins, false, false, false))
                 return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
     }
@@ -4639,10 +4889,9 @@ void UnloadBlockIndex()
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
+    CBlockIndex::ClearAccumulatorCheckpoints();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -527,13 +527,51 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
-    }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, 1);
+        if (blockPayees.HasPayeeWithVotes(winnerIn.payee, 2))
+            mapPayeeVotedHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::IndexBlockPayees(const CMasternodeBlockPayees& blockPayees)
+{
+    for (const CMasternodePayee& payee : blockPayees.vecPayments) {
+        if (payee.nVotes >= 2)
+            mapPayeeVotedHeights[payee.scriptPubKey].insert(blockPayees.nBlockHeight);
+    }
+}
+
+void CMasternodePayments::UnindexBlockPayees(const CMasternodeBlockPayees& blockPayees)
+{
+    for (const CMasternodePayee& payee : blockPayees.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator it = mapPayeeVotedHeights.find(payee.scriptPubKey);
+        if (it == mapPayeeVotedHeights.end())
+            continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if (it->second.empty())
+            mapPayeeVotedHeights.erase(it);
+    }
+}
+
+int CMasternodePayments::GetLastVotedHeight(const CScript& payee, int nMinHeight, int nMaxHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::set<int> >::iterator it = mapPayeeVotedHeights.find(payee);
+    if (it == mapPayeeVotedHeights.end())
+        return -1;
+
+    std::set<int>::iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin())
+        return -1;
+    --itHeight;
+    return *itHeight > nMinHeight ? *itHeight : -1;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -640,7 +678,11 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            std::map<int, CMasternodeBlockPayees>::iterator itBlock = mapMasternodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapMasternodeBlocks.end()) {
+                UnindexBlockPayees(itBlock->second);
+                mapMasternodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
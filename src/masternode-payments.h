@@ -12,6 +12,8 @@
 #include "main.h"
 #include "masternode.h"
 
+#include <set>
+
 
 extern RecursiveMutex cs_vecPayments;
 extern RecursiveMutex cs_mapMasternodeBlocks;
@@ -233,6 +235,11 @@ class CMasternodePayments
 private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
+    // heights at which each payee has been voted for by at least 2 masternodes, kept in step with mapMasternodeBlocks
+    std::map<CScript, std::set<int> > mapPayeeVotedHeights;
+
+    void IndexBlockPayees(const CMasternodeBlockPayees& blockPayees);
+    void UnindexBlockPayees(const CMasternodeBlockPayees& blockPayees);
 
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
@@ -250,6 +257,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeVotedHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -258,6 +266,8 @@ public:
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
+    /// Highest height in (nMinHeight, nMaxHeight] at which payee has been voted for by at least 2 masternodes, or -1
+    int GetLastVotedHeight(const CScript& payee, int nMinHeight, int nMaxHeight);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
@@ -293,6 +303,12 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead()) {
+            LOCK(cs_mapMasternodeBlocks);
+            mapPayeeVotedHeights.clear();
+            for (const auto& blockPayees : mapMasternodeBlocks)
+                IndexBlockPayees(blockPayees.second);
+        }
     }
 };
 
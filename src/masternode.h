@@ -222,7 +222,8 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    /// nEnabledCount is the number of enabled masternodes, counted when left to -1
+    int64_t SecondsSincePayment(int nEnabledCount = -1);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -277,7 +278,7 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    int64_t GetLastPaid(int nEnabledCount = -1);
     bool IsValidNetAddr();
 
     /// Is the input associated with collateral public key? (and there is 10000 PWRB - checking if valid masternode)
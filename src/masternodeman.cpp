@@ -41,6 +41,14 @@ struct CompareScoreTxIn {
     }
 };
 
+struct CompareScorePtr {
+    bool operator()(const std::pair<int64_t, CMasternode*>& t1,
+        const std::pair<int64_t, CMasternode*>& t2) const
+    {
+        return t1.first < t2.first;
+    }
+};
+
 struct CompareScoreMN {
     bool operator()(const std::pair<int64_t, CMasternode>& t1,
         const std::pair<int64_t, CMasternode>& t2) const
@@ -205,6 +213,66 @@ CMasternodeMan::CMasternodeMan()
     nDsqCount = 0;
 }
 
+void CMasternodeMan::AddToIndexes(std::list<CMasternode>::iterator it)
+{
+    listScoreTables.clear();
+    {
+        LOCK(cs_collaterals);
+        setCollaterals.insert(it->vin.prevout);
+    }
+    mapCollateralIndex.emplace(it->vin.prevout, it);
+    mapPayeeIndex.emplace(it->pubKeyCollateralAddress.GetID(), it);
+    mapPubKeyIndex.emplace(it->pubKeyMasternode, it);
+}
+
+template <typename Index, typename Key>
+static void EraseIndexEntry(Index& index, const Key& key, std::list<CMasternode>::iterator it)
+{
+    auto range = index.equal_range(key);
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second == it) {
+            index.erase(i);
+            return;
+        }
+    }
+}
+
+void CMasternodeMan::RemoveFromIndexes(std::list<CMasternode>::iterator it)
+{
+    listScoreTables.clear();
+    if (mapCollateralIndex.count(it->vin.prevout) == 1) {
+        LOCK(cs_collaterals);
+        setCollaterals.erase(it->vin.prevout);
+        setSpentCollaterals.erase(it->vin.prevout);
+        setMempoolSpentCollaterals.erase(it->vin.prevout);
+    }
+    EraseIndexEntry(mapCollateralIndex, it->vin.prevout, it);
+    EraseIndexEntry(mapPayeeIndex, it->pubKeyCollateralAddress.GetID(), it);
+    EraseIndexEntry(mapPubKeyIndex, it->pubKeyMasternode, it);
+}
+
+std::list<CMasternode>::iterator CMasternodeMan::Erase(std::list<CMasternode>::iterator it)
+{
+    RemoveFromIndexes(it);
+    return listMasternodes.erase(it);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    listScoreTables.clear();
+    {
+        LOCK(cs_collaterals);
+        setCollaterals.clear();
+        setSpentCollaterals.clear();
+        setMempoolSpentCollaterals.clear();
+    }
+    mapCollateralIndex.clear();
+    mapPayeeIndex.clear();
+    mapPubKeyIndex.clear();
+    for (std::list<CMasternode>::iterator it = listMasternodes.begin(); it != listMasternodes.end(); ++it)
+        AddToIndexes(it);
+}
+
 bool CMasternodeMan::Add(CMasternode& mn)
 {
     LOCK(cs);
@@ -215,7 +283,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
     CMasternode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vMasternodes.push_back(mn);
+        listMasternodes.push_back(mn);
+        AddToIndexes(std::prev(listMasternodes.end()));
         return true;
     }
 
@@ -242,7 +311,7 @@ void CMasternodeMan::Check()
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
     }
 }
@@ -254,8 +323,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    std::vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
+    std::list<CMasternode>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
             (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
             (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
@@ -285,7 +354,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
-            it = vMasternodes.erase(it);
+            it = Erase(it);
         } else {
             ++it;
         }
@@ -346,7 +415,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
-    vMasternodes.clear();
+    listMasternodes.clear();
+    RebuildIndexes();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -362,7 +432,7 @@ int CMasternodeMan::stable_size ()
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         if (mn.protocolVersion < nMinProtocol) {
             continue; // Skip obsolete versions
         }
@@ -387,7 +457,7 @@ int CMasternodeMan::CountEnabled(int protocolVersion)
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -400,7 +470,7 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         std::string strHost;
         int port;
@@ -442,28 +512,104 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+bool CMasternodeMan::IsCollateralSpent(const COutPoint& collateral) const
+{
+    LOCK(cs_collaterals);
+    return setSpentCollaterals.count(collateral) || setMempoolSpentCollaterals.count(collateral);
+}
+
+void CMasternodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase())
+        return;
+
+    LOCK(cs_collaterals);
+    if (setCollaterals.empty())
+        return;
+
+    for (const CTxIn& txin : tx.vin) {
+        if (!setCollaterals.count(txin.prevout))
+            continue;
+        if (pblock) {
+            setMempoolSpentCollaterals.erase(txin.prevout);
+            if (setSpentCollaterals.insert(txin.prevout).second)
+                LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Masternode collateral %s spent by %s in block %s\n", txin.prevout.ToString(), tx.GetHash().ToString(), pblock->GetHash().ToString());
+        } else {
+            // Accepted to the mempool, or back from a disconnected block: the spend is only
+            // kept for as long as CheckCollaterals still finds it in the mempool
+            setSpentCollaterals.erase(txin.prevout);
+            if (setMempoolSpentCollaterals.insert(txin.prevout).second)
+                LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Masternode collateral %s spent by %s in the mempool\n", txin.prevout.ToString(), tx.GetHash().ToString());
+        }
+    }
+}
+
+void CMasternodeMan::CheckCollaterals()
+{
+    std::vector<COutPoint> vCollaterals;
+    {
+        LOCK(cs_collaterals);
+        vCollaterals.reserve(setCollaterals.size());
+        for (const COutPoint& collateral : setCollaterals) {
+            if (!setSpentCollaterals.count(collateral))
+                vCollaterals.push_back(collateral);
+        }
+    }
+
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) return;
+    LOCK(mempool.cs);
+
+    std::vector<COutPoint> vSpent;
+    std::set<COutPoint> setMempoolSpent;
+    for (const COutPoint& collateral : vCollaterals) {
+        const CCoins* coins = pcoinsTip->AccessCoins(collateral.hash);
+        bool fAvailable = coins ? coins->IsAvailable(collateral.n) : mempool.exists(collateral.hash);
+        if (!fAvailable)
+            vSpent.push_back(collateral);
+        else if (mempool.mapNextTx.count(collateral))
+            setMempoolSpent.insert(collateral);
+    }
+
+    // Updated under the mempool lock, so that no SyncTransaction can slip in between
+    LOCK(cs_collaterals);
+    for (const COutPoint& collateral : vCollaterals) {
+        if (setMempoolSpentCollaterals.count(collateral) && !setMempoolSpent.count(collateral)) {
+            setMempoolSpentCollaterals.erase(collateral);
+            LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Masternode collateral %s spend left the mempool\n", collateral.ToString());
+        }
+    }
+    for (const COutPoint& collateral : setMempoolSpent) {
+        if (setCollaterals.count(collateral))
+            setMempoolSpentCollaterals.insert(collateral);
+    }
+    for (const COutPoint& collateral : vSpent) {
+        setMempoolSpentCollaterals.erase(collateral);
+        if (setCollaterals.count(collateral) && setSpentCollaterals.insert(collateral).second)
+            LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Masternode collateral %s found spent\n", collateral.ToString());
+    }
+}
+
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
+    // masternodes are paid to the P2PKH script of their collateral address
+    if (!payee.IsPayToPublicKeyHash())
+        return NULL;
+    CKeyID keyID(uint160(std::vector<unsigned char>(payee.begin() + 3, payee.begin() + 23)));
+
     LOCK(cs);
-    CScript payee2;
 
-    for (CMasternode& mn : vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    // entries sharing a key are indexed in the order they were added
+    std::multimap<CKeyID, std::list<CMasternode>::iterator>::iterator it = mapPayeeIndex.find(keyID);
+    return it != mapPayeeIndex.end() ? &*it->second : NULL;
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::map<COutPoint, std::list<CMasternode>::iterator>::iterator it = mapCollateralIndex.find(vin.prevout);
+    return it != mapCollateralIndex.end() ? &*it->second : NULL;
 }
 
 
@@ -471,11 +617,8 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    std::multimap<CPubKey, std::list<CMasternode>::iterator>::iterator it = mapPubKeyIndex.find(pubKeyMasternode);
+    return it != mapPubKeyIndex.end() ? &*it->second : NULL;
 }
 
 //
@@ -493,7 +636,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     */
 
     int nMnCount = CountEnabled();
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -509,7 +652,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -556,7 +699,7 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     LogPrint(BCLog::MASTERNODE, "CMasternodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         found = false;
         for (CTxIn& usedVin : vecToExclude) {
@@ -580,7 +723,7 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     CMasternode* winner = NULL;
 
     // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
@@ -598,46 +741,66 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+const std::vector<std::pair<int64_t, CMasternode*> >* CMasternodeMan::GetScoreTable(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
+    AssertLockHeld(cs);
 
     //make sure we know about this block
-    uint256 hash;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    uint256 hashBlock;
+    if (!GetBlockHash(hashBlock, nBlockHeight)) return NULL;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
+    for (std::list<CScoreTable>::iterator it = listScoreTables.begin(); it != listScoreTables.end(); ++it) {
+        if (it->hashBlock == hashBlock && it->minProtocol == minProtocol) {
+            listScoreTables.splice(listScoreTables.begin(), listScoreTables, it);
+            return &listScoreTables.front().vScores;
         }
+    }
+
+    CScoreTable table;
+    table.hashBlock = hashBlock;
+    table.minProtocol = minProtocol;
+    for (CMasternode& mn : listMasternodes) {
+        if (mn.protocolVersion < minProtocol) continue;
 
-        if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
-                LogPrint(BCLog::MASTERNODE,"Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
-                continue;                                                   // Skip masternodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
         uint256 n = mn.CalculateScore(1, nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
+        table.vScores.push_back(std::make_pair(n2, &mn));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    sort(table.vScores.rbegin(), table.vScores.rend(), CompareScorePtr());
+
+    listScoreTables.push_front(std::move(table));
+    if (listScoreTables.size() > MASTERNODES_SCORE_TABLES)
+        listScoreTables.pop_back();
+    return &listScoreTables.front().vScores;
+}
 
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
+    int64_t nMasternode_Age = 0;
+
+    const std::vector<std::pair<int64_t, CMasternode*> >* pvScores = GetScoreTable(nBlockHeight, minProtocol);
+    if (!pvScores) return -1;
+
+    bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
     int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
+    for (const std::pair<int64_t, CMasternode*>& s : *pvScores) {
+        CMasternode& mn = *s.second;
+        if (fCheckAge) {
+            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
+            if ((nMasternode_Age) < nMasternode_Min_Age) continue;     // Skip masternodes younger than (default) 1 hour
+        }
+        if (fOnlyActive) {
+            mn.Check();
+            if (!mn.IsEnabled()) continue;
+        }
+
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -647,36 +810,29 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<std::pair<int64_t, CMasternode> > vecMasternodeScores;
+    LOCK(cs);
+
     std::vector<std::pair<int, CMasternode> > vecMasternodeRanks;
 
-    //make sure we know about this block
-    uint256 hash;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    const std::vector<std::pair<int64_t, CMasternode*> >* pvScores = GetScoreTable(nBlockHeight, minProtocol);
+    if (!pvScores) return vecMasternodeRanks;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    // the disabled masternodes are ranked last
+    std::vector<CMasternode*> vDisabled;
+    int rank = 0;
+    for (const std::pair<int64_t, CMasternode*>& s : *pvScores) {
+        CMasternode& mn = *s.second;
         mn.Check();
-
-        if (mn.protocolVersion < minProtocol) continue;
-
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(std::make_pair(9999, mn));
+            vDisabled.push_back(&mn);
             continue;
         }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn));
+        rank++;
+        vecMasternodeRanks.push_back(std::make_pair(rank, mn));
     }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CMasternode) & s : vecMasternodeScores) {
+    for (CMasternode* pmn : vDisabled) {
         rank++;
-        vecMasternodeRanks.push_back(std::make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(std::make_pair(rank, *pmn));
     }
 
     return vecMasternodeRanks;
@@ -684,29 +840,21 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
+    const std::vector<std::pair<int64_t, CMasternode*> >* pvScores = GetScoreTable(nBlockHeight, minProtocol);
+    if (!pvScores) return NULL;
+
+    int rank = 0;
+    for (const std::pair<int64_t, CMasternode*>& s : *pvScores) {
         if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
+            s.second->Check();
+            if (!s.second->IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return s.second;
         }
     }
 
@@ -814,7 +962,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         int nInvCount = 0;
 
-        for (CMasternode& mn : vMasternodes) {
+        for (CMasternode& mn : listMasternodes) {
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -846,14 +994,10 @@ void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    std::vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
-            break;
-        }
-        ++it;
+    std::map<COutPoint, std::list<CMasternode>::iterator>::iterator it = mapCollateralIndex.find(vin.prevout);
+    if (it != mapCollateralIndex.end() && it->second->vin == vin) {
+        LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Removing Masternode %s - %i now\n", vin.prevout.hash.ToString(), size() - 1);
+        Erase(it->second);
     }
 }
 
@@ -870,15 +1014,31 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
         CMasternode mn(mnb);
         Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        UpdateFromNewBroadcast(pmn, mnb);
     }
 }
 
+bool CMasternodeMan::UpdateFromNewBroadcast(CMasternode* pmn, CMasternodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    std::map<COutPoint, std::list<CMasternode>::iterator>::iterator it = mapCollateralIndex.find(pmn->vin.prevout);
+    if (it == mapCollateralIndex.end() || &*it->second != pmn)
+        return pmn->UpdateFromNewBroadcast(mnb);
+
+    // the broadcast may carry new keys
+    std::list<CMasternode>::iterator itMn = it->second;
+    RemoveFromIndexes(itMn);
+    bool fUpdated = pmn->UpdateFromNewBroadcast(mnb);
+    AddToIndexes(itMn);
+    return fUpdated;
+}
+
 std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Masternodes: " << (int)vMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
+    info << "Masternodes: " << (int)listMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
 
     return info.str();
 }
@@ -907,6 +1067,7 @@ void ThreadCheckMasternodes()
             if (c % MASTERNODE_PING_SECONDS == 1) activeMasternode.ManageStatus();
 
             if (c % 60 == 0) {
+                mnodeman.CheckCollaterals();
                 mnodeman.CheckAndRemove();
                 masternodePayments.CleanPaymentList();
                 CleanTransactionLocksList();
@@ -16,9 +16,13 @@
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
+
+#include <list>
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SCORE_TABLES 10
 
 
 class CMasternodeMan;
@@ -54,7 +58,7 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
-class CMasternodeMan
+class CMasternodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -63,8 +67,22 @@ private:
     // critical section to protect the inner data structures specifically on messaging
     mutable RecursiveMutex cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CMasternode> vMasternodes;
+    // list to hold all MNs, in the order they were added. Entries never move, so the
+    // pointers handed out by Find stay valid until the masternode is removed.
+    std::list<CMasternode> listMasternodes;
+    // indexes into listMasternodes, by collateral outpoint, payee and masternode pubkey
+    std::map<COutPoint, std::list<CMasternode>::iterator> mapCollateralIndex;
+    std::multimap<CKeyID, std::list<CMasternode>::iterator> mapPayeeIndex;
+    std::multimap<CPubKey, std::list<CMasternode>::iterator> mapPubKeyIndex;
+
+    // critical section to protect the collateral tracking. Taken with cs_main held, so
+    // never lock cs_main or cs while holding it.
+    mutable RecursiveMutex cs_collaterals;
+    // collaterals of the listed masternodes, those spent in a connected block, and those
+    // spent by a transaction seen outside a block, which only counts while it is in the mempool
+    std::set<COutPoint> setCollaterals;
+    std::set<COutPoint> setSpentCollaterals;
+    std::set<COutPoint> setMempoolSpentCollaterals;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -72,6 +90,22 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // masternodes sorted by score for a block, highest first
+    struct CScoreTable {
+        uint256 hashBlock;
+        int minProtocol;
+        std::vector<std::pair<int64_t, CMasternode*> > vScores;
+    };
+    // the most recently used score tables, most recent first. Cleared whenever the list changes.
+    std::list<CScoreTable> listScoreTables;
+
+    const std::vector<std::pair<int64_t, CMasternode*> >* GetScoreTable(int64_t nBlockHeight, int minProtocol);
+
+    void AddToIndexes(std::list<CMasternode>::iterator it);
+    void RemoveFromIndexes(std::list<CMasternode>::iterator it);
+    std::list<CMasternode>::iterator Erase(std::list<CMasternode>::iterator it);
+    void RebuildIndexes();
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -88,7 +122,15 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
         LOCK(cs);
+        // stored as a vector
+        std::vector<CMasternode> vMasternodes;
+        if (!ser_action.ForRead())
+            vMasternodes.assign(listMasternodes.begin(), listMasternodes.end());
         READWRITE(vMasternodes);
+        if (ser_action.ForRead()) {
+            listMasternodes.assign(vMasternodes.begin(), vMasternodes.end());
+            RebuildIndexes();
+        }
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -139,7 +181,8 @@ public:
     std::vector<CMasternode> GetFullMasternodeVector()
     {
         Check();
-        return vMasternodes;
+        LOCK(cs);
+        return std::vector<CMasternode>(listMasternodes.begin(), listMasternodes.end());
     }
 
     std::vector<std::pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
@@ -149,7 +192,7 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
-    int size() { return vMasternodes.size(); }
+    int size() { return listMasternodes.size(); }
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
@@ -162,6 +205,20 @@ public:
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
+
+    /// Update a listed masternode from a newer broadcast, keeping the indexes in sync
+    bool UpdateFromNewBroadcast(CMasternode* pmn, CMasternodeBroadcast& mnb);
+
+    /// Has the collateral of a listed masternode been spent?
+    bool IsCollateralSpent(const COutPoint& collateral) const;
+
+    /// Look up all the listed collaterals in the coins tip and the mempool, to catch spends missed by
+    /// SyncTransaction and forget the mempool spends that were evicted or conflicted
+    void CheckCollaterals();
+
+protected:
+    // CValidationInterface
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
 };
 
 void ThreadCheckMasternodes();
@@ -47,22 +47,93 @@
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool. The mempool tracks each entry's in-mempool
+// ancestors, so block assembly selects whole packages (a transaction and its
+// not yet included ancestors) by their combined fee rate.
 //
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
+// Once some ancestors of an entry are in the block, its package shrinks and
+// its score in the mempool's ancestor index no longer applies. Such entries
+// are tracked in an indexed_modified_transaction_set with updated package
+// size and fees.
+//
+struct CTxMemPoolModifiedEntry {
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nSizeWithAncestors = entry->GetSizeWithAncestors();
+        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+};
+
+struct CompareCTxMemPoolIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator()(const CTxMemPoolModifiedEntry& entry) const
+    {
+        return entry.iter;
+    }
+};
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+// Same ordering as CompareTxMemPoolEntryByAncestorFee, on the modified package state
+struct CompareModifiedEntry {
+    bool operator()(const CTxMemPoolModifiedEntry& a, const CTxMemPoolModifiedEntry& b) const
     {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2)
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        return f1 > f2;
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified ancestor fee rate
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<ancestor_score>,
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion {
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator()(CTxMemPoolModifiedEntry& e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+    }
+
+    CTxMemPool::txiter iter;
+};
+
+// Sort a package so that parents come before their children
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
     }
 };
 
@@ -70,7 +141,7 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
 // We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
+typedef boost::tuple<double, CFeeRate, CTxMemPool::txiter> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -92,6 +163,408 @@ public:
     }
 };
 
+static TxPriority GetTxPriority(CTxMemPool::txiter iter, int nHeight)
+{
+    double dPriority = iter->GetPriority(nHeight);
+    CAmount dummy = 0;
+    mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+    return TxPriority(dPriority, CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()), iter);
+}
+
+/** The checks of a block transaction that don't depend on the coins it spends. */
+static bool IsBlockTxAllowed(const CTransaction& tx, int nHeight)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+        return false;
+    if (sporkManager.IsSporkActive(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+        return false;
+
+    //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+    for (const CTxIn& txin : tx.vin) {
+        if (invalid_out::ContainsOutPoint(txin.prevout)) {
+            LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Check that tx can be included in a block at nHeight on top of view, and
+ * apply it to view. vSerials holds the zPWRB serials already spent in the block.
+ * Scripts are only verified with fCheckScripts.
+ */
+static bool TestBlockTx(const CTransaction& tx, int nHeight, CCoinsViewCache& view, std::vector<CBigNum>& vSerials,
+                        unsigned int& nTxSigOps, CAmount& nTxFees, bool fCheckScripts)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    if (!IsBlockTxAllowed(tx, nHeight))
+        return false;
+
+    if (!view.HaveInputs(tx))
+        return false;
+
+    // double check that there are no double spent zPWRB spends in this block or tx
+    std::vector<CBigNum> vTxSerials;
+    if (tx.HasZerocoinSpendInputs()) {
+        int nHeightTx = 0;
+        if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+            return false;
+
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CTxIn& txIn = tx.vin[i];
+            if (txIn.IsZerocoinSpend() || txIn.IsZerocoinPublicSpend()) {
+                CValidationState state;
+                CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, i, state);
+                if (!pspend){
+                    throw std::runtime_error("Invalid public spend parse");
+                }
+                const libzerocoin::CoinSpend* spend = pspend->spend.get();
+
+                bool fUseV1Params = spend->getCoinVersion() < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                //This zPWRB serial has already been included in the block, do not add this tx.
+                if (!spend->HasValidSerial(consensus.Zerocoin_Params(fUseV1Params)) ||
+                    std::count(vSerials.begin(), vSerials.end(), spend->getCoinSerialNumber()) ||
+                    std::count(vTxSerials.begin(), vTxSerials.end(), spend->getCoinSerialNumber()))
+                    return false;
+                vTxSerials.emplace_back(spend->getCoinSerialNumber());
+            }
+        }
+    }
+
+    nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+    nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, view);
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    if (!CheckInputs(tx, state, view, fCheckScripts, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        return false;
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, nHeight);
+    vSerials.insert(vSerials.end(), vTxSerials.begin(), vTxSerials.end());
+    return true;
+}
+
+/** Track the packages of the in-mempool descendants of the transactions just added to the block. */
+static void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, const CTxMemPool::setEntries& inBlock,
+                                   indexed_modified_transaction_set& mapModifiedTx)
+{
+    for (CTxMemPool::txiter it : alreadyAdded) {
+        CTxMemPool::setEntries descendants;
+        mempool.CalculateDescendants(it, descendants);
+        for (CTxMemPool::txiter desc : descendants) {
+            if (inBlock.count(desc))
+                continue;
+            modtxiter mit = mapModifiedTx.find(desc);
+            if (mit == mapModifiedTx.end())
+                mit = mapModifiedTx.insert(CTxMemPoolModifiedEntry(desc)).first;
+            mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+        }
+    }
+}
+
+/**
+ * The mempool transactions selected for the next block. The selection is kept
+ * across CreateNewBlock calls and made again when the mempool or the chain tip
+ * changed, so that a new template only verifies the scripts of the transactions
+ * it didn't already have. Guarded by mempool.cs.
+ */
+struct CBlockTxSelection {
+    //! Best block of the coins view, height, mempool update counter and zPWRB
+    //! maintenance spork state the selection was made against
+    uint256 hashBestBlock;
+    int nHeight;
+    unsigned int nTransactionsUpdated;
+    bool fZerocoinMaintenance;
+    bool fValid;
+
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    //! zPWRB serials spent by the selected transactions
+    std::vector<CBigNum> vSerials;
+    uint64_t nBlockSize;
+    int nBlockSigOps;
+    CAmount nFees;
+
+    CBlockTxSelection()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBestBlock.SetNull();
+        nHeight = 0;
+        nTransactionsUpdated = 0;
+        fZerocoinMaintenance = false;
+        fValid = false;
+        vtx.clear();
+        vTxFees.clear();
+        vTxSigOps.clear();
+        vSerials.clear();
+        nBlockSize = 1000;
+        nBlockSigOps = 100;
+        nFees = 0;
+    }
+
+    void Add(const CTransaction& tx, unsigned int nTxSize, CAmount nTxFees, unsigned int nTxSigOps)
+    {
+        vtx.push_back(tx);
+        vTxFees.push_back(nTxFees);
+        vTxSigOps.push_back(nTxSigOps);
+        nBlockSize += nTxSize;
+        nBlockSigOps += nTxSigOps;
+        nFees += nTxFees;
+    }
+};
+
+static CBlockTxSelection blockTxSelection;
+
+/** High priority transactions, included regardless of their fees up to nBlockPrioritySize */
+static void SelectPriorityTxs(CBlockTxSelection& selection, CCoinsViewCache& view, CTxMemPool::setEntries& inBlock,
+                              const std::set<uint256>& setVerified, int nHeight, unsigned int nBlockMaxSize,
+                              unsigned int nBlockPrioritySize, bool fPrintPriority)
+{
+    if (nBlockPrioritySize == 0)
+        return;
+
+    // A transaction becomes a candidate once all its in-mempool parents are in the block
+    std::vector<TxPriority> vecPriority;
+    TxPriorityCompare comparer(false);
+    for (CTxMemPool::txiter mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi) {
+        if (mi->GetCountWithAncestors() == 1)
+            vecPriority.push_back(GetTxPriority(mi, nHeight));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty()) {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().get<0>();
+        CFeeRate feeRate = vecPriority.front().get<1>();
+        CTxMemPool::txiter iter = vecPriority.front().get<2>();
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // The rest of the block is filled by fee once past the priority size or out of high-priority transactions
+        unsigned int nTxSize = iter->GetTxSize();
+        if (selection.nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(dPriority))
+            break;
+
+        // Size limits
+        if (selection.nBlockSize + nTxSize >= nBlockMaxSize)
+            continue;
+
+        CCoinsViewCache viewTx(&view);
+        std::vector<CBigNum> vSerials(selection.vSerials);
+        unsigned int nTxSigOps = 0;
+        CAmount nTxFees = 0;
+        if (!TestBlockTx(iter->GetTx(), nHeight, viewTx, vSerials, nTxSigOps, nTxFees, !setVerified.count(iter->GetTx().GetHash())))
+            continue;
+        // Legacy limits on sigOps:
+        if (selection.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_CURRENT)
+            continue;
+        viewTx.Flush();
+        selection.vSerials.swap(vSerials);
+
+        // Added
+        selection.Add(iter->GetTx(), nTxSize, nTxFees, nTxSigOps);
+        inBlock.insert(iter);
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, feeRate.ToString(), iter->GetTx().GetHash().ToString());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        for (CTxMemPool::txiter child : mempool.GetMemPoolChildren(iter)) {
+            bool fParentsInBlock = true;
+            for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(child)) {
+                if (!inBlock.count(parent)) {
+                    fParentsInBlock = false;
+                    break;
+                }
+            }
+            if (fParentsInBlock) {
+                vecPriority.push_back(GetTxPriority(child, nHeight));
+                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            }
+        }
+    }
+}
+
+/**
+ * Whole packages by ancestor fee rate: the mempool's ancestor index, merged
+ * with the packages that shrank because some ancestors are in the block.
+ */
+static void SelectPackageTxs(CBlockTxSelection& selection, CCoinsViewCache& view, CTxMemPool::setEntries& inBlock,
+                             const std::set<uint256>& setVerified, int nHeight, unsigned int nBlockMaxSize,
+                             unsigned int nBlockMinSize, bool fPrintPriority)
+{
+    indexed_modified_transaction_set mapModifiedTx;
+    CTxMemPool::setEntries failedTx;
+    UpdatePackagesForAdded(inBlock, inBlock, mapModifiedTx);
+
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) {
+        // Skip entries that are in the block, have failed or are tracked as modified
+        if (mi != mempool.mapTx.get<ancestor_score>().end()) {
+            CTxMemPool::txiter it = mempool.mapTx.project<0>(mi);
+            if (inBlock.count(it) || failedTx.count(it) || mapModifiedTx.count(it)) {
+                ++mi;
+                continue;
+            }
+        }
+
+        // Take the best of the next mempool entry and the best modified entry
+        bool fUsingModified = false;
+        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
+        CTxMemPool::txiter iter;
+        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
+            iter = modit->iter;
+            fUsingModified = true;
+        } else {
+            iter = mempool.mapTx.project<0>(mi);
+            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
+                CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
+                iter = modit->iter;
+                fUsingModified = true;
+            } else {
+                ++mi;
+            }
+        }
+        assert(!inBlock.count(iter));
+
+        uint64_t nPackageSize = fUsingModified ? modit->nSizeWithAncestors : iter->GetSizeWithAncestors();
+        CAmount nPackageFees = fUsingModified ? modit->nModFeesWithAncestors : iter->GetModFeesWithAncestors();
+
+        // Stop at free packages once past the minimum block size, every package left pays less
+        if (!iter->GetTx().HasZerocoinSpendInputs() && CFeeRate(nPackageFees, nPackageSize) < ::minRelayTxFee &&
+            selection.nBlockSize + nPackageSize >= nBlockMinSize)
+            break;
+
+        bool fFailed = selection.nBlockSize + nPackageSize >= nBlockMaxSize;
+
+        // The package is the transaction and its ancestors not yet in the block, parents first
+        std::vector<CTxMemPool::txiter> vPackage;
+        CTxMemPool::setEntries ancestors;
+        CCoinsViewCache viewPackage(&view);
+        std::vector<CBigNum> vSerials(selection.vSerials);
+        std::vector<CAmount> vPackageFees;
+        std::vector<unsigned int> vPackageSigOps;
+        unsigned int nPackageSigOps = 0;
+        if (!fFailed) {
+            mempool.CalculateMemPoolAncestors(*iter, ancestors);
+            ancestors.insert(iter);
+            for (CTxMemPool::txiter it : ancestors) {
+                if (!inBlock.count(it))
+                    vPackage.push_back(it);
+            }
+            std::sort(vPackage.begin(), vPackage.end(), CompareTxIterByAncestorCount());
+
+            for (CTxMemPool::txiter it : vPackage) {
+                unsigned int nTxSigOps = 0;
+                CAmount nTxFees = 0;
+                if (!TestBlockTx(it->GetTx(), nHeight, viewPackage, vSerials, nTxSigOps, nTxFees, !setVerified.count(it->GetTx().GetHash()))) {
+                    fFailed = true;
+                    break;
+                }
+                vPackageFees.push_back(nTxFees);
+                vPackageSigOps.push_back(nTxSigOps);
+                nPackageSigOps += nTxSigOps;
+            }
+            // Legacy limits on sigOps:
+            if (selection.nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS_CURRENT)
+                fFailed = true;
+        }
+
+        if (fFailed) {
+            if (fUsingModified)
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+            failedTx.insert(iter);
+            continue;
+        }
+
+        viewPackage.Flush();
+        selection.vSerials.swap(vSerials);
+        CTxMemPool::setEntries added;
+        for (unsigned int i = 0; i < vPackage.size(); i++) {
+            CTxMemPool::txiter it = vPackage[i];
+            selection.Add(it->GetTx(), it->GetTxSize(), vPackageFees[i], vPackageSigOps[i]);
+            inBlock.insert(it);
+            added.insert(it);
+            mapModifiedTx.erase(it);
+
+            if (fPrintPriority) {
+                LogPrintf("fee %s txid %s\n",
+                    CFeeRate(it->GetModifiedFee(), it->GetTxSize()).ToString(), it->GetTx().GetHash().ToString());
+            }
+        }
+        UpdatePackagesForAdded(added, inBlock, mapModifiedTx);
+    }
+}
+
+/** Bring blockTxSelection up to date with the mempool and the coins tip. */
+static void UpdateBlockTxSelection(int nHeight, unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    CCoinsViewCache view(pcoinsTip);
+    uint256 hashBestBlock = view.GetBestBlock();
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    // The spork can switch by time as well as by message, so its state is part of the key
+    bool fZerocoinMaintenance = sporkManager.IsSporkActive(SPORK_16_ZEROCOIN_MAINTENANCE_MODE);
+    if (blockTxSelection.fValid && blockTxSelection.hashBestBlock == hashBestBlock &&
+        blockTxSelection.nHeight == nHeight && blockTxSelection.nTransactionsUpdated == nTransactionsUpdated &&
+        blockTxSelection.fZerocoinMaintenance == fZerocoinMaintenance)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    bool fPrintPriority = GetBoolArg("-printpriority", false);
+    // The previously selected transactions compete with the new ones again, so that better
+    // paying packages can take their place. Their scripts were verified against the same
+    // outputs already, only the inexpensive checks are run again. zPWRB spends are fully
+    // checked against the spent serials.
+    std::set<uint256> setVerified;
+    if (blockTxSelection.fValid) {
+        for (const CTransaction& tx : blockTxSelection.vtx) {
+            if (!tx.HasZerocoinSpendInputs())
+                setVerified.insert(tx.GetHash());
+        }
+    }
+
+    CBlockTxSelection selection;
+    CTxMemPool::setEntries inBlock;
+    SelectPriorityTxs(selection, view, inBlock, setVerified, nHeight, nBlockMaxSize, nBlockPrioritySize, fPrintPriority);
+    SelectPackageTxs(selection, view, inBlock, setVerified, nHeight, nBlockMaxSize, nBlockMinSize, fPrintPriority);
+
+    size_t nKept = 0;
+    for (const CTransaction& tx : selection.vtx)
+        nKept += setVerified.count(tx.GetHash());
+    LogPrint(BCLog::BENCH, "%s : %u transactions (%u kept, %u of the previous selection dropped) in %.2fms\n", __func__,
+             selection.vtx.size(), nKept, blockTxSelection.vtx.size() - nKept, 0.001 * (GetTimeMicros() - nTimeStart));
+
+    selection.hashBestBlock = hashBestBlock;
+    selection.nHeight = nHeight;
+    selection.nTransactionsUpdated = nTransactionsUpdated;
+    selection.fZerocoinMaintenance = fZerocoinMaintenance;
+    selection.fValid = true;
+    std::swap(blockTxSelection, selection);
+}
+
+std::vector<CTransaction> GetBlockTxSelection(int nHeight, unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    LOCK2(cs_main, mempool.cs);
+    UpdateBlockTxSelection(nHeight, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+    return blockTxSelection.vtx;
+}
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -126,9 +599,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     if (!pindexPrev) return nullptr;
     const int nHeight = pindexPrev->nHeight + 1;
 
-    // Make sure to create the correct block version
-    const Consensus::Params& consensus = Params().GetConsensus();
-
     //!> Block v7: Removes accumulator checkpoints
     pblock->nVersion = CBlockHeader::CURRENT_VERSION;
     // -regtest only: allow overriding block.nVersion with
@@ -147,21 +617,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     pblocktemplate->vTxFees.push_back(-1);   // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    if (fProofOfStake) {
-        boost::this_thread::interruption_point();
-        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
-        CMutableTransaction txCoinStake;
-        int64_t nTxNewTime = 0;
-        if (!pwallet->CreateCoinStake(*pwallet, pindexPrev, pblock->nBits, txCoinStake, nTxNewTime)) {
-            LogPrint(BCLog::STAKING, "%s : stake not found\n", __func__);
-            return nullptr;
-        }
-        // Stake found
-        pblock->nTime = nTxNewTime;
-        pblock->vtx[0].vout[0].SetEmpty();
-        pblock->vtx.push_back(CTransaction(txCoinStake));
-    }
-
     // Largest block you're willing to create:
     unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
     // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
@@ -178,241 +633,41 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
+    if (fProofOfStake) {
+        // Bring the transaction selection up to date before searching for a kernel,
+        // so that a found stake doesn't wait on transaction verification.
+        {
+            LOCK2(cs_main, mempool.cs);
+            UpdateBlockTxSelection(nHeight, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+        }
+
+        boost::this_thread::interruption_point();
+        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+        CMutableTransaction txCoinStake;
+        int64_t nTxNewTime = 0;
+        if (!pwallet->CreateCoinStake(*pwallet, pindexPrev, pblock->nBits, txCoinStake, nTxNewTime)) {
+            LogPrint(BCLog::STAKING, "%s : stake not found\n", __func__);
+            return nullptr;
+        }
+        // Stake found
+        pblock->nTime = nTxNewTime;
+        pblock->vtx[0].vout[0].SetEmpty();
+        pblock->vtx.push_back(CTransaction(txCoinStake));
+    }
+
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
 
     {
         LOCK2(cs_main, mempool.cs);
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (std::map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(sporkManager.IsSporkActive(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            bool hasZerocoinSpends = tx.HasZerocoinSpendInputs();
-            if (hasZerocoinSpends)
-                nTotalIn = tx.GetZerocoinSpent();
-
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (invalid_out::ContainsOutPoint(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
-                }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                // zPWRB spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        std::vector<CBigNum> vBlockSerials;
-        std::vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.HasZerocoinSpendInputs() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            // double check that there are no double spent zPWRB spends in this block or tx
-            if (tx.HasZerocoinSpendInputs()) {
-                int nHeightTx = 0;
-                if (IsTransactionInChain(tx.GetHash(), nHeightTx))
-                    continue;
-
-                bool fDoubleSerial = false;
-                for (const CTxIn& txIn : tx.vin) {
-                    bool isPublicSpend = txIn.IsZerocoinPublicSpend();
-                    if (txIn.IsZerocoinSpend() || isPublicSpend) {
-                        libzerocoin::CoinSpend* spend;
-                        if (isPublicSpend) {
-                            libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                            PublicCoinSpend publicSpend(params);
-                            CValidationState state;
-                            if (!ZPWRBModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
-                                throw std::runtime_error("Invalid public spend parse");
-                            }
-                            spend = &publicSpend;
-                        } else {
-                            libzerocoin::CoinSpend spendObj = TxInToZerocoinSpend(txIn);
-                            spend = &spendObj;
-                        }
-
-                        bool fUseV1Params = spend->getCoinVersion() < libzerocoin::PrivateCoin::PUBKEY_VERSION;
-                        if (!spend->HasValidSerial(consensus.Zerocoin_Params(fUseV1Params)))
-                            fDoubleSerial = true;
-                        if (std::count(vBlockSerials.begin(), vBlockSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (std::count(vTxSerials.begin(), vTxSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (fDoubleSerial)
-                            break;
-                        vTxSerials.emplace_back(spend->getCoinSerialNumber());
-                    }
-                }
-                //This zPWRB serial has already been included in the block, do not add this tx.
-                if (fDoubleSerial)
-                    continue;
-            }
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum& bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        UpdateBlockTxSelection(nHeight, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+        const CBlockTxSelection& selection = blockTxSelection;
+        pblock->vtx.insert(pblock->vtx.end(), selection.vtx.begin(), selection.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), selection.vTxFees.begin(), selection.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), selection.vTxSigOps.begin(), selection.vTxSigOps.end());
+        nFees = selection.nFees;
+        uint64_t nBlockSize = selection.nBlockSize;
+        uint64_t nBlockTx = selection.vtx.size();
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -459,14 +714,25 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         }
 
         CValidationState state;
-        if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
-            LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
-            mempool.clear();
-            return nullptr;
-        }
+        if (TestBlockValidity(state, *pblock, pindexPrev, false, false))
+            return pblocktemplate.release();
+        LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
     }
 
-    return pblocktemplate.release();
+    // Start over from an empty mempool. The wallets are told about the transactions
+    // that left it once mempool.cs is released, they lock it after cs_wallet.
+    std::vector<CTransaction> vCleared;
+    LOCK(cs_main);
+    {
+        LOCK(mempool.cs);
+        for (const CTxMemPoolEntry& entry : mempool.mapTx)
+            vCleared.push_back(entry.GetTx());
+        mempool.clear();
+        blockTxSelection.SetNull();
+    }
+    for (const CTransaction& tx : vCleared)
+        SyncWithWallets(tx, NULL);
+    return nullptr;
 }
 
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
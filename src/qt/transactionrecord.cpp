@@ -294,22 +294,17 @@ QList<TransactionRecord> TransactionRecord::decomposeTransaction(const CWallet*
                     sub.address = mapValue["zerocoinmint"];
                     sub.credit += txout.nValue;
                 } else {
-                    std::string scriptPubKey = ScriptToAsmStr(txout.scriptPubKey);
                     if (!betTx) {
                         // Sent to IP, or other non-address transaction like OP_EVAL
                         sub.type = TransactionRecord::SendToOther;
                         sub.address = mapValue["to"];
                     }
-                    if (scriptPubKey.length() > 0 && strncmp(scriptPubKey.c_str(), "OP_RETURN", 9) == 0) {
+                    if (!txout.scriptPubKey.empty() && txout.scriptPubKey[0] == OP_RETURN) {
                         betTx = true;
                         sub.type = TransactionRecord::Bet;
 
-                        // Get the OP CODE from the transaction scriptPubKey.
-                        std::vector<unsigned char> vOpCode = ParseHex(scriptPubKey.substr(9, std::string::npos));
-                        std::string opCode(vOpCode.begin(), vOpCode.end());
                         CLottoBet lb;
-
-                        if(CLottoBet::FromOpCode(opCode, lb)) {
+                        if(CLottoBet::FromScript(txout.scriptPubKey, lb)) {
                         	std::string sDate = std::to_string(lb.nDate);
                         	if (sDate.length() >= 8) {
                         		sub.address = sDate.substr(4,2) + "-" + sDate.substr(6,2) + " : ";
@@ -173,7 +173,6 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"placebet", 3},
         {"listbets", 1},
         {"listbets", 2},
-        {"listbets", 3},
     };
 
 class CRPCConvertTable
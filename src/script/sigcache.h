@@ -8,10 +8,39 @@
 
 #include "script/interpreter.h"
 
+#include <string.h>
 #include <vector>
 
+// DoS prevention: limit the signature and script execution caches to 32MiB together
+// (over 1000000 entries on 64-bit systems). Due to how we count cache size, actual
+// memory usage is slightly more (~32.125 MiB)
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+// Maximum sig cache size allowed
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+/**
+ * Picks the slots of a signature cache entry. The entries are salted SHA256
+ * hashes already, so each 32 bit word of an entry is an independent hash.
+ */
+class SignatureCacheHasher
+{
+public:
+    uint32_t operator()(const uint256& key, uint8_t n) const
+    {
+        uint32_t u;
+        memcpy(&u, key.begin() + 4 * n, 4);
+        return u;
+    }
+};
+
+/** Signature cache lookups since startup */
+struct CSignatureCacheStats {
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -23,4 +52,8 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Size the signature cache from -maxsigcachesize (MiB). */
+void InitSignatureCache();
+CSignatureCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -37,10 +37,12 @@ bool CPwrbStake::InitFromTxIn(const CTxIn& txin)
     return true;
 }
 
-bool CPwrbStake::SetPrevout(CTransaction txPrev, unsigned int n)
+bool CPwrbStake::SetPrevout(CTransaction txPrev, unsigned int n, CBlockIndex* pindexFromIn)
 {
     this->txFrom = txPrev;
     this->nPosition = n;
+    // when known by the caller, GetIndexFrom doesn't need to look the transaction up
+    this->pindexFrom = pindexFromIn;
     return true;
 }
 
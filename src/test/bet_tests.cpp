@@ -0,0 +1,331 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "betting/bet.h"
+#include "betting/drawresults.h"
+#include "chain.h"
+#include "core_io.h"
+#include "random.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+#include "validationinterface.h"
+#include "test/test_pwrb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(bet_tests, TestingSetup)
+
+static CBetIndexEntry BetEntry(const CBlockIndex* pindex, CAmount nBetValue)
+{
+    CBetIndexEntry entry;
+    entry.hashBlock = pindex->GetBlockHash();
+    entry.nBlockTime = pindex->GetBlockTime();
+    entry.nBetValue = nBetValue;
+    entry.nNumber1 = 7;
+    return entry;
+}
+
+BOOST_AUTO_TEST_CASE(betdb_draw_range)
+{
+    CBetDB betdb(0, true, true);
+
+    // A short chain of block indexes, heights 250..260
+    std::vector<uint256> vHashes(11);
+    std::vector<CBlockIndex> vBlocks(11);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vHashes[i] = GetRandHash();
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].nHeight = 250 + i;
+        vBlocks[i].nTime = 1600000000 + 60 * i;
+        vBlocks[i].pprev = i > 0 ? &vBlocks[i - 1] : nullptr;
+    }
+
+    const uint32_t nDate = 20201010, nOtherDate = 20201014;
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        const CBlockIndex* pindex = &vBlocks[i];
+        std::vector<std::pair<CBetIndexKey, CBetIndexEntry> > vBets;
+        // heights crossing a byte boundary must still come back in chain order
+        vBets.emplace_back(CBetIndexKey(nDate, pindex->nHeight, 3, 1), BetEntry(pindex, 3 * COIN));
+        vBets.emplace_back(CBetIndexKey(nDate, pindex->nHeight, 2, 0), BetEntry(pindex, 2 * COIN));
+        vBets.emplace_back(CBetIndexKey(nOtherDate, pindex->nHeight, 2, 1), BetEntry(pindex, 1 * COIN));
+        std::vector<CTxOut> vPaid;
+        if (i % 2 == 0)
+            vPaid.emplace_back(i * COIN, CScript() << OP_TRUE);
+        BOOST_CHECK(betdb.WriteBlockBets(pindex, vBets, vPaid));
+    }
+
+    uint256 hashBest;
+    BOOST_CHECK(betdb.ReadBestBlock(hashBest));
+    BOOST_CHECK(hashBest == vHashes.back());
+
+    std::vector<std::pair<CBetIndexKey, CBetIndexEntry> > vBets;
+    BOOST_CHECK(betdb.ReadDrawBets(nDate, 254, 257, vBets));
+    BOOST_CHECK_EQUAL(vBets.size(), 8);
+    for (unsigned int i = 0; i < vBets.size(); i++) {
+        BOOST_CHECK_EQUAL(vBets[i].first.nDate, nDate);
+        BOOST_CHECK_EQUAL(vBets[i].first.nHeight, 254 + i / 2);
+        BOOST_CHECK_EQUAL(vBets[i].first.nTx, i % 2 == 0 ? 2 : 3);
+        BOOST_CHECK(vBets[i].second.hashBlock == vHashes[4 + i / 2]);
+    }
+
+    std::vector<std::pair<int, CBetPayoutRecord> > vPayouts;
+    BOOST_CHECK(betdb.ReadBetPayouts(250, 260, vPayouts));
+    BOOST_CHECK_EQUAL(vPayouts.size(), 6);
+    for (unsigned int i = 0; i < vPayouts.size(); i++) {
+        BOOST_CHECK_EQUAL(vPayouts[i].first, 250 + 2 * i);
+        BOOST_CHECK_EQUAL(vPayouts[i].second.vPaid.size(), 1);
+    }
+
+    // Disconnecting the tip unwinds its records
+    const CBlockIndex* pindexTip = &vBlocks.back();
+    std::vector<CBetIndexKey> vKeys;
+    vKeys.emplace_back(nDate, pindexTip->nHeight, 3, 1);
+    vKeys.emplace_back(nDate, pindexTip->nHeight, 2, 0);
+    vKeys.emplace_back(nOtherDate, pindexTip->nHeight, 2, 1);
+    BOOST_CHECK(betdb.EraseBlockBets(pindexTip, vKeys));
+    BOOST_CHECK(betdb.ReadBestBlock(hashBest));
+    BOOST_CHECK(hashBest == vHashes[vHashes.size() - 2]);
+
+    vBets.clear();
+    BOOST_CHECK(betdb.ReadDrawBets(nDate, 0, 1000, vBets));
+    BOOST_CHECK_EQUAL(vBets.size(), 20);
+    vPayouts.clear();
+    BOOST_CHECK(betdb.ReadBetPayouts(0, 1000, vPayouts));
+    BOOST_CHECK_EQUAL(vPayouts.size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(draw_result_oracle)
+{
+    std::string strPrimary = "[{\"draw_date\":\"2020-10-10T00:00:00\"}]";
+    bool fBackupUp = false;
+    CDrawResultOracle oracle(
+        [&](std::string& strResults) { strResults = strPrimary; return true; },
+        [&](std::string& strResults) { strResults = "[{}]"; return fBackupUp; });
+
+    std::shared_ptr<const CDrawResults> first = oracle.GetSnapshot();
+    BOOST_CHECK_EQUAL(first->nVersion, 0);
+    BOOST_CHECK(first->strPrimary.empty());
+
+    BOOST_CHECK(oracle.Refresh());
+    std::shared_ptr<const CDrawResults> second = oracle.GetSnapshot();
+    BOOST_CHECK_EQUAL(second->nVersion, 1);
+    BOOST_CHECK(second->fFetched);
+    BOOST_CHECK_EQUAL(second->strPrimary, strPrimary);
+    BOOST_CHECK(second->strBackup.empty());
+    // Snapshots already handed out are never modified
+    BOOST_CHECK(first->strPrimary.empty());
+
+    // A source returning garbage keeps its previous results
+    strPrimary = "<html>503</html>";
+    fBackupUp = true;
+    BOOST_CHECK(oracle.Refresh());
+    std::shared_ptr<const CDrawResults> third = oracle.GetSnapshot();
+    BOOST_CHECK_EQUAL(third->nVersion, 2);
+    BOOST_CHECK_EQUAL(third->strPrimary, second->strPrimary);
+    BOOST_CHECK_EQUAL(third->strBackup, "[{}]");
+    BOOST_CHECK(third->hashResults != second->hashResults);
+
+    strPrimary = "[]";
+    fBackupUp = false;
+    BOOST_CHECK(!oracle.Refresh());
+    BOOST_CHECK_EQUAL(oracle.GetSnapshot()->strPrimary, second->strPrimary);
+    BOOST_CHECK(!oracle.GetSnapshot()->fFetched);
+
+    // A block is parked until it has been retried against fresher results
+    CDrawResults results;
+    results.nVersion = 3;
+    results.fFetched = true;
+    const uint256 hashBlock = GetRandHash();
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+    results.nVersion = 4;
+    BOOST_CHECK(!oracle.ParkBlock(hashBlock, results));
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+    oracle.UnparkBlock(hashBlock);
+    results.nVersion = 5;
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+
+    // Results that could not be refreshed never reject a block
+    results.nVersion = 6;
+    results.fFetched = false;
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+    results.nVersion = 7;
+    BOOST_CHECK(oracle.ParkBlock(hashBlock, results));
+    results.nVersion = 8;
+    results.fFetched = true;
+    BOOST_CHECK(!oracle.ParkBlock(hashBlock, results));
+
+    // The parked blocks are bounded, an evicted block is parked anew
+    results.nVersion = 9;
+    std::vector<uint256> vParked;
+    for (unsigned int i = 0; i <= MAX_PARKED_BLOCKS; i++) {
+        vParked.push_back(GetRandHash());
+        BOOST_CHECK(oracle.ParkBlock(vParked.back(), results));
+    }
+    results.nVersion = 10;
+    unsigned int nRejected = 0;
+    for (const uint256& hash : vParked)
+        if (!oracle.ParkBlock(hash, results))
+            nRejected++;
+    BOOST_CHECK(nRejected <= MAX_PARKED_BLOCKS);
+    BOOST_CHECK(nRejected >= MAX_PARKED_BLOCKS - 1);
+}
+
+/** The asm round trip bets used to be decoded with. */
+static bool DecodeBetFromAsm(const CScript& script, CLottoBet& lb)
+{
+    std::string scriptPubKey = ScriptToAsmStr(script);
+    if (scriptPubKey.length() == 0 || strncmp(scriptPubKey.c_str(), "OP_RETURN", 9) != 0)
+        return false;
+    std::vector<unsigned char> vOpCode = ParseHex(scriptPubKey.substr(9, std::string::npos));
+    return CLottoBet::FromOpCode(std::string(vOpCode.begin(), vOpCode.end()), lb);
+}
+
+static std::vector<unsigned char> BetOpCode(const CLottoBet& lb)
+{
+    std::string opCode;
+    BOOST_CHECK(CLottoBet::ToOpCode(lb, opCode));
+    return ParseHex(opCode);
+}
+
+static void CheckSameDecoding(const CScript& script)
+{
+    CLottoBet lbScript(0, 0, 0, 0), lbAsm(0, 0, 0, 0);
+    bool fScript = CLottoBet::FromScript(script, lbScript);
+    BOOST_CHECK_EQUAL(fScript, DecodeBetFromAsm(script, lbAsm));
+    if (fScript) {
+        BOOST_CHECK_EQUAL(lbScript.nDate, lbAsm.nDate);
+        BOOST_CHECK_EQUAL(lbScript.nNumber1, lbAsm.nNumber1);
+        BOOST_CHECK_EQUAL(lbScript.nNumber2, lbAsm.nNumber2);
+        BOOST_CHECK_EQUAL(lbScript.nNumber3, lbAsm.nNumber3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lottobet_script_decoding)
+{
+    CLottoBet lb(20201014, 3, 17, 0x1234);
+    std::vector<unsigned char> vOpCode = BetOpCode(lb);
+    BOOST_CHECK_EQUAL(vOpCode.size(), 13);
+
+    CLottoBet decoded;
+    BOOST_CHECK(CLottoBet::FromScript(CScript() << OP_RETURN << vOpCode, decoded));
+    BOOST_CHECK_EQUAL(decoded.nDate, lb.nDate);
+    BOOST_CHECK_EQUAL(decoded.nNumber1, lb.nNumber1);
+    BOOST_CHECK_EQUAL(decoded.nNumber2, lb.nNumber2);
+    BOOST_CHECK_EQUAL(decoded.nNumber3, lb.nNumber3);
+
+    // Scripts off the canonical layout decode as they did through the asm form
+    CheckSameDecoding(CScript() << OP_RETURN << vOpCode);
+    CheckSameDecoding(CScript() << OP_RETURN);
+    CheckSameDecoding(CScript());
+    CheckSameDecoding(CScript() << OP_TRUE);
+    CheckSameDecoding(CScript() << OP_RETURN << vOpCode << OP_TRUE);
+    CheckSameDecoding(CScript() << OP_RETURN << std::vector<unsigned char>(vOpCode.begin(), vOpCode.begin() + 8)
+                                << std::vector<unsigned char>(vOpCode.begin() + 8, vOpCode.end()));
+    std::vector<unsigned char> vPushData1 = {OP_RETURN, OP_PUSHDATA1, 13};
+    vPushData1.insert(vPushData1.end(), vOpCode.begin(), vOpCode.end());
+    CheckSameDecoding(CScript(vPushData1.begin(), vPushData1.end()));
+    for (unsigned int i = 0; i < 3; i++) {
+        std::vector<unsigned char> vBad(vOpCode);
+        vBad[i] ^= 0x40;
+        CheckSameDecoding(CScript() << OP_RETURN << vBad);
+    }
+    CheckSameDecoding(CScript() << OP_RETURN << std::vector<unsigned char>(vOpCode.begin(), vOpCode.end() - 1));
+
+    // A block full of bet outputs, some below the accepted bet range or malformed
+    CBlock block;
+    block.vtx.resize(50);
+    unsigned int nExpected = 0;
+    for (unsigned int nTx = 0; nTx < block.vtx.size(); nTx++) {
+        CMutableTransaction tx;
+        for (unsigned int i = 0; i < 100; i++) {
+            CLottoBet bet(20201010 + nTx, i % 70, (i * 7) % 70, nTx % 27);
+            std::vector<unsigned char> vBet = BetOpCode(bet);
+            if (i % 10 == 9)
+                vBet[0] = 'C';
+            CAmount nValue = i % 10 == 8 ? COIN / 100 : (1 + i) * COIN;
+            tx.vout.emplace_back(nValue, CScript() << OP_RETURN << vBet);
+            if (i % 10 < 8)
+                nExpected++;
+        }
+        block.vtx[nTx] = CTransaction(tx);
+    }
+
+    std::vector<CBlockLottoBet> vBets;
+    GetBlockLottoBets(block, vBets);
+    BOOST_CHECK_EQUAL(vBets.size(), nExpected);
+    for (const CBlockLottoBet& bet : vBets) {
+        const CTxOut& txout = block.vtx[bet.nTx].vout[bet.nOut];
+        CLottoBet lbAsm;
+        BOOST_CHECK(DecodeBetFromAsm(txout.scriptPubKey, lbAsm));
+        BOOST_CHECK_EQUAL(bet.nBetValue, txout.nValue);
+        BOOST_CHECK_EQUAL(bet.bet.nDate, lbAsm.nDate);
+        BOOST_CHECK_EQUAL(bet.bet.nNumber1, lbAsm.nNumber1);
+        BOOST_CHECK_EQUAL(bet.bet.nNumber2, lbAsm.nNumber2);
+        BOOST_CHECK_EQUAL(bet.bet.nNumber3, lbAsm.nNumber3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bet_payout_cache)
+{
+    CBetPayoutCache cache;
+    RegisterValidationInterface(&cache);
+
+    uint256 hashTip = GetRandHash(), hashInputs = GetRandHash();
+    std::vector<CBetOut> vPayouts;
+    vPayouts.emplace_back(12 * COIN, CScript() << OP_TRUE, COIN);
+
+    std::vector<CBetOut> vCached;
+    BOOST_CHECK(!cache.Get(hashTip, hashInputs, vCached));
+    cache.Put(hashTip, hashInputs, vPayouts);
+    BOOST_CHECK(cache.Get(hashTip, hashInputs, vCached));
+    BOOST_CHECK_EQUAL(vCached.size(), 1);
+    BOOST_CHECK_EQUAL(vCached[0].nValue, 12 * COIN);
+    BOOST_CHECK_EQUAL(vCached[0].nBetValue, COIN);
+    // Other results or another tip miss
+    BOOST_CHECK(!cache.Get(hashTip, GetRandHash(), vCached));
+    BOOST_CHECK(!cache.Get(GetRandHash(), hashInputs, vCached));
+
+    // An empty payout vector is a result too
+    uint256 hashOtherTip = GetRandHash();
+    cache.Put(hashOtherTip, hashInputs, std::vector<CBetOut>());
+    BOOST_CHECK(cache.Get(hashOtherTip, hashInputs, vCached));
+    BOOST_CHECK(vCached.empty());
+
+    // Disconnecting the tip drops its payouts
+    CBlockIndex index;
+    index.phashBlock = &hashTip;
+    GetMainSignals().BlockDisconnected(CBlock(), &index);
+    BOOST_CHECK(!cache.Get(hashTip, hashInputs, vCached));
+    BOOST_CHECK(cache.Get(hashOtherTip, hashInputs, vCached));
+
+    // The oldest entries are evicted first
+    for (size_t i = 0; i < CBetPayoutCache::MAX_ENTRIES; i++)
+        cache.Put(GetRandHash(), hashInputs, vPayouts);
+    BOOST_CHECK(!cache.Get(hashOtherTip, hashInputs, vCached));
+
+    UnregisterValidationInterface(&cache);
+}
+
+BOOST_AUTO_TEST_CASE(bet_settlement_helpers)
+{
+    // One, two or three numbers pay 12, 200 or 3500 times the bet
+    BOOST_CHECK_EQUAL(GetLottoBetPayout(CLottoBet(20200603, 7, 0, 0), COIN), 12 * COIN);
+    BOOST_CHECK_EQUAL(GetLottoBetPayout(CLottoBet(20200603, 0, 7, 21), COIN), 200 * COIN);
+    BOOST_CHECK_EQUAL(GetLottoBetPayout(CLottoBet(20200603, 7, 21, 42), 2 * COIN), 7000 * COIN);
+    BOOST_CHECK_EQUAL(GetLottoBetPayout(CLottoBet(20200603, 0, 0, 0), COIN), 0);
+
+    // The last draw time before Thu 2020-06-04 20:00 UTC is Thu 02:59 UTC, for the draw of Wed 2020-06-03
+    const std::time_t nTipTime = 1591300800;
+    BOOST_CHECK_EQUAL(GetPaidDrawDate(nTipTime), 20200603);
+    BOOST_CHECK_EQUAL(GetPaidDrawDate(1577923200), 20191228); // Thu 2020-01-02 00:00 UTC
+    BOOST_CHECK(IsBetPayoutHeight(60 * 1500, nTipTime));
+    BOOST_CHECK(!IsBetPayoutHeight(60 * 1500 + 1, nTipTime));
+    // Later payout blocks wait two more hours after the draw
+    BOOST_CHECK(!IsBetPayoutHeight(60 * 1500, nTipTime - 60 * 60 * 2));
+    BOOST_CHECK(!IsBetPayoutHeight(70 * 1500, nTipTime));
+    BOOST_CHECK(IsBetPayoutHeight(70 * 1500, nTipTime + 60 * 60));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
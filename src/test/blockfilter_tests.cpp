@@ -0,0 +1,190 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "test/test_pwrb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, TestingSetup)
+
+static GCSFilter::Element FilterElement(unsigned char nSet, unsigned int n)
+{
+    GCSFilter::Element element(32, nSet);
+    element[0] = n & 0xff;
+    element[1] = n >> 8;
+    return element;
+}
+
+static GCSFilter::Element FilterElement(const CScript& script)
+{
+    return GCSFilter::Element(script.begin(), script.end());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (unsigned int i = 0; i < 100; ++i) {
+        included_elements.insert(FilterElement(1, i));
+        excluded_elements.insert(FilterElement(2, i));
+    }
+
+    GCSFilter filter(GCSFilter::Params(0, 0, 10, 1 << 10), included_elements);
+    for (const GCSFilter::Element& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet one_element;
+        one_element.insert(element);
+        BOOST_CHECK(filter.MatchAny(one_element));
+    }
+    BOOST_CHECK(!filter.MatchAny(excluded_elements));
+    BOOST_CHECK(!filter.MatchAny(GCSFilter::ElementSet()));
+
+    // The decoded filter matches the same elements
+    GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_CHECK(decoded.MatchAny(included_elements));
+    BOOST_CHECK(!decoded.MatchAny(excluded_elements));
+
+    // Trailing data is rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filter.GetParams(), encoded), std::ios_base::failure);
+
+    GCSFilter empty;
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included_elements));
+}
+
+BOOST_AUTO_TEST_CASE(bitstream_test)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        BitStreamWriter<CDataStream> bitwriter(stream);
+        bitwriter.Write(0, 1);
+        bitwriter.Write(2, 2);
+        bitwriter.Write(6, 3);
+        bitwriter.Write(11, 4);
+        bitwriter.Write(1, 5);
+        bitwriter.Write(32, 6);
+        bitwriter.Write(7, 7);
+        bitwriter.Write(30497, 16);
+    }
+    BOOST_CHECK_EQUAL(stream.size(), 6U);
+
+    BitStreamReader<CDataStream> bitreader(stream);
+    BOOST_CHECK_EQUAL(bitreader.Read(1), 0U);
+    BOOST_CHECK_EQUAL(bitreader.Read(2), 2U);
+    BOOST_CHECK_EQUAL(bitreader.Read(3), 6U);
+    BOOST_CHECK_EQUAL(bitreader.Read(4), 11U);
+    BOOST_CHECK_EQUAL(bitreader.Read(5), 1U);
+    BOOST_CHECK_EQUAL(bitreader.Read(6), 32U);
+    BOOST_CHECK_EQUAL(bitreader.Read(7), 7U);
+    BOOST_CHECK_EQUAL(bitreader.Read(16), 30497U);
+    BOOST_CHECK_THROW(bitreader.Read(8), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CKey key1, key2, key3;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    key3.MakeNewKey(true);
+    CScript scriptKey1 = GetScriptForDestination(key1.GetPubKey().GetID());
+    CScript scriptKey2 = GetScriptForDestination(key2.GetPubKey().GetID());
+    CScript scriptKey3 = GetScriptForDestination(key3.GetPubKey().GetID());
+    CScript scriptColdStake = GetScriptForStakeDelegation(key2.GetPubKey().GetID(), key3.GetPubKey().GetID());
+    CScript scriptSpent = GetScriptForRawPubKey(key1.GetPubKey());
+    CScript scriptData = CScript() << OP_RETURN << std::vector<unsigned char>(4, 0x42);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(4);
+    tx.vout[0].scriptPubKey = scriptKey1;
+    tx.vout[1].scriptPubKey = scriptColdStake;
+    tx.vout[2].scriptPubKey = scriptData;
+    tx.vout[3].scriptPubKey = CScript();
+
+    CBlock block;
+    block.vtx.push_back(tx);
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(1, scriptSpent));
+
+    BlockFilter block_filter(block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+    BOOST_CHECK(block_filter.GetBlockHash() == block.GetHash());
+
+    // Outputs, spent outputs and the two keys of the cold staking script
+    BOOST_CHECK_EQUAL(filter.GetN(), 5U);
+    BOOST_CHECK(filter.Match(FilterElement(scriptKey1)));
+    BOOST_CHECK(filter.Match(FilterElement(scriptColdStake)));
+    BOOST_CHECK(filter.Match(FilterElement(scriptKey2)));
+    BOOST_CHECK(filter.Match(FilterElement(scriptKey3)));
+    BOOST_CHECK(filter.Match(FilterElement(scriptSpent)));
+    BOOST_CHECK(!filter.Match(FilterElement(scriptData)));
+
+    // Serialization round trip
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    BlockFilter block_filter2;
+    stream >> block_filter2;
+    BOOST_CHECK(block_filter2.GetBlockHash() == block_filter.GetBlockHash());
+    BOOST_CHECK(block_filter2.GetEncodedFilter() == block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter2.GetFilter().Match(FilterElement(scriptSpent)));
+
+    // Filter header chain
+    uint256 prev_header = GetRandHash();
+    uint256 filter_hash = block_filter.GetHash();
+    BOOST_CHECK(block_filter.ComputeHeader(prev_header) == Hash(filter_hash.begin(), filter_hash.end(), prev_header.begin(), prev_header.end()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilterdb_test)
+{
+    CBlockFilterDB filterdb(0, true, true);
+
+    std::vector<BlockFilter> vFilters;
+    for (unsigned int i = 0; i < 3; i++) {
+        CMutableTransaction tx;
+        tx.vout.resize(i + 1);
+        for (unsigned int j = 0; j <= i; j++)
+            tx.vout[j].scriptPubKey = CScript() << std::vector<unsigned char>(20, i) << OP_EQUAL;
+        CBlock block;
+        block.nNonce = i;
+        block.vtx.push_back(tx);
+        vFilters.push_back(BlockFilter(block, CBlockUndo()));
+    }
+
+    uint256 hashHeader;
+    for (const BlockFilter& filter : vFilters) {
+        BOOST_CHECK(!filterdb.HaveFilter(filter.GetBlockHash()));
+        hashHeader = filter.ComputeHeader(hashHeader);
+        BOOST_CHECK(filterdb.WriteFilter(filter, hashHeader));
+    }
+
+    for (const BlockFilter& filter : vFilters) {
+        BlockFilter filterRead;
+        BOOST_CHECK(filterdb.HaveFilter(filter.GetBlockHash()));
+        BOOST_CHECK(filterdb.ReadFilter(filter.GetBlockHash(), filterRead));
+        BOOST_CHECK(filterRead.GetEncodedFilter() == filter.GetEncodedFilter());
+        BOOST_CHECK_EQUAL(filterRead.GetFilter().GetN(), filter.GetFilter().GetN());
+    }
+    uint256 hashHeaderRead;
+    BOOST_CHECK(filterdb.ReadFilterHeader(vFilters.back().GetBlockHash(), hashHeaderRead));
+    BOOST_CHECK(hashHeaderRead == hashHeader);
+
+    BlockFilter filterMissing;
+    BOOST_CHECK(!filterdb.ReadFilter(GetRandHash(), filterMissing));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
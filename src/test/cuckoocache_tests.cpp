@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "test/test_pwrb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> CTestCache;
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_erase)
+{
+    CTestCache cache;
+    uint256 hash = GetRandHash();
+    // Not set up yet: nothing is stored
+    cache.insert(hash);
+    BOOST_CHECK(!cache.contains(hash, false));
+
+    BOOST_CHECK_EQUAL(cache.setup_bytes(1 << 20), (1 << 20) / sizeof(uint256));
+    cache.insert(hash);
+    BOOST_CHECK(cache.contains(hash, false));
+    BOOST_CHECK(!cache.contains(GetRandHash(), false));
+
+    // Setting up again empties the cache
+    cache.setup_bytes(1 << 20);
+    BOOST_CHECK(!cache.contains(hash, false));
+
+    // In a 2 slot cache, a and c can only go to slot 0, b and d to slot 1
+    cache.setup(2);
+    uint256 a, b, c, d;
+    memset(b.begin(), 0xFF, 32);
+    memset(c.begin(), 0x01, 32);
+    memset(d.begin(), 0xF0, 32);
+    cache.insert(a);
+    cache.insert(b);
+    BOOST_CHECK(cache.contains(a, false) && cache.contains(b, false));
+
+    // An erased element stays until an insert reuses its slot
+    BOOST_CHECK(cache.contains(b, true));
+    BOOST_CHECK(cache.contains(b, false));
+    cache.insert(d);
+    BOOST_CHECK(!cache.contains(b, false));
+    BOOST_CHECK(cache.contains(a, false) && cache.contains(d, false));
+
+    // Without a free slot, the new element evicts an old one
+    cache.insert(c);
+    BOOST_CHECK(cache.contains(c, false));
+    BOOST_CHECK(!cache.contains(a, false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    CTestCache cache;
+    const uint32_t nSize = cache.setup(1 << 16);
+
+    // Filled to half its size, the cache keeps (almost) everything
+    std::vector<uint256> vHashes;
+    for (uint32_t i = 0; i < nSize / 2; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.insert(vHashes.back());
+    }
+    size_t nFound = 0;
+    for (const uint256& hash : vHashes)
+        nFound += cache.contains(hash, false);
+    BOOST_CHECK(nFound >= vHashes.size() * 99 / 100);
+
+    // Overfilled, it stays bounded and keeps most of what fits
+    for (uint32_t i = 0; i < nSize; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.insert(vHashes.back());
+    }
+    nFound = 0;
+    for (const uint256& hash : vHashes)
+        nFound += cache.contains(hash, false);
+    BOOST_CHECK(nFound <= nSize);
+    BOOST_CHECK(nFound >= nSize * 90 / 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
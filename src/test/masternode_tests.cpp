@@ -0,0 +1,245 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "validationinterface.h"
+#include "test/test_pwrb.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_tests, TestingSetup)
+
+static CPubKey NewPubKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+
+static CMasternode NewMasternode(const CPubKey& pubKeyCollateral)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(GetRandHash(), 1);
+    mn.pubKeyCollateralAddress = pubKeyCollateral;
+    mn.pubKeyMasternode = NewPubKey();
+    return mn;
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_indexes)
+{
+    CMasternodeMan man;
+
+    // two masternodes sharing a collateral address
+    CPubKey pubKeyShared = NewPubKey();
+    CMasternode mn1 = NewMasternode(pubKeyShared);
+    CMasternode mn2 = NewMasternode(pubKeyShared);
+    CMasternode mn3 = NewMasternode(NewPubKey());
+    BOOST_CHECK(man.Add(mn1));
+    BOOST_CHECK(man.Add(mn2));
+    BOOST_CHECK(man.Add(mn3));
+    BOOST_CHECK(!man.Add(mn1));
+    BOOST_CHECK_EQUAL(man.size(), 3);
+
+    CMasternode* pmn1 = man.Find(mn1.vin);
+    CMasternode* pmn3 = man.Find(mn3.vin);
+    BOOST_CHECK(pmn1 && pmn1->vin == mn1.vin);
+    BOOST_CHECK(pmn3 && pmn3->vin == mn3.vin);
+    BOOST_CHECK(man.Find(CTxIn(GetRandHash(), 0)) == NULL);
+
+    // the first masternode added for a payee is found
+    BOOST_CHECK(man.Find(GetScriptForDestination(pubKeyShared.GetID())) == pmn1);
+    BOOST_CHECK(man.Find(GetScriptForDestination(mn3.pubKeyCollateralAddress.GetID())) == pmn3);
+    BOOST_CHECK(man.Find(CScript() << ToByteVector(pubKeyShared) << OP_CHECKSIG) == NULL);
+    BOOST_CHECK(man.Find(mn3.pubKeyMasternode) == pmn3);
+    BOOST_CHECK(man.Find(NewPubKey()) == NULL);
+
+    // handles stay valid while other masternodes come and go
+    for (int i = 0; i < 100; i++) {
+        CMasternode mn = NewMasternode(NewPubKey());
+        BOOST_CHECK(man.Add(mn));
+    }
+    man.Remove(mn2.vin);
+    BOOST_CHECK(man.Find(mn2.vin) == NULL);
+    BOOST_CHECK(man.Find(mn1.vin) == pmn1);
+    BOOST_CHECK(man.Find(mn3.vin) == pmn3);
+    BOOST_CHECK(pmn3->pubKeyMasternode == mn3.pubKeyMasternode);
+
+    man.Remove(mn1.vin);
+    BOOST_CHECK(man.Find(GetScriptForDestination(pubKeyShared.GetID())) == NULL);
+
+    // a newer broadcast moves the masternode to its new key
+    CMasternodeBroadcast mnb(*pmn3);
+    mnb.pubKeyMasternode = NewPubKey();
+    mnb.sigTime = pmn3->sigTime + 1;
+    BOOST_CHECK(man.UpdateFromNewBroadcast(pmn3, mnb));
+    BOOST_CHECK(man.Find(mnb.pubKeyMasternode) == pmn3);
+    BOOST_CHECK(man.Find(mn3.pubKeyMasternode) == NULL);
+    BOOST_CHECK_EQUAL(man.size(), 101);
+
+    man.Clear();
+    BOOST_CHECK(man.Find(mn3.vin) == NULL);
+}
+
+static CTransaction SpendCollateral(const CMasternode& mn)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(GetRandHash(), 0);
+    tx.vin.push_back(mn.vin);
+    tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    return CTransaction(tx);
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_collateral_spends)
+{
+    CMasternodeMan man;
+    RegisterValidationInterface(&man);
+
+    CMasternode mn1 = NewMasternode(NewPubKey());
+    CMasternode mn2 = NewMasternode(NewPubKey());
+    CMasternode mn3 = NewMasternode(NewPubKey());
+    BOOST_CHECK(man.Add(mn1));
+    BOOST_CHECK(man.Add(mn2));
+    BOOST_CHECK(man.Add(mn3));
+
+    // the collaterals of mn1 and mn3 are unspent in the coins tip, the one of mn2 is missing
+    {
+        LOCK(cs_main);
+        for (const CMasternode* pmn : {&mn1, &mn3}) {
+            CCoinsModifier coins = pcoinsTip->ModifyCoins(pmn->vin.prevout.hash);
+            coins->vout.resize(pmn->vin.prevout.n + 1);
+            coins->vout[pmn->vin.prevout.n] = CTxOut(COIN, CScript() << OP_TRUE);
+            coins->nHeight = 1;
+        }
+    }
+
+    // spends are picked up from the transactions seen
+    CTransaction tx1 = SpendCollateral(mn1);
+    GetMainSignals().SyncTransaction(tx1, NULL);
+    BOOST_CHECK(man.IsCollateralSpent(mn1.vin.prevout));
+    BOOST_CHECK(!man.IsCollateralSpent(mn2.vin.prevout));
+    BOOST_CHECK(!man.IsCollateralSpent(tx1.vin[0].prevout));
+
+    // a spend seen outside a block is dropped once it is no longer in the mempool
+    man.CheckCollaterals();
+    BOOST_CHECK(!man.IsCollateralSpent(mn1.vin.prevout));
+    // the sweep finds the collateral missing from the coins tip
+    BOOST_CHECK(man.IsCollateralSpent(mn2.vin.prevout));
+
+    // but kept while it is
+    CTransaction tx3 = SpendCollateral(mn3);
+    mempool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 0, 0, 0.0, 1));
+    GetMainSignals().SyncTransaction(tx3, NULL);
+    man.CheckCollaterals();
+    BOOST_CHECK(man.IsCollateralSpent(mn3.vin.prevout));
+    std::list<CTransaction> removed;
+    mempool.remove(tx3, removed, true);
+    man.CheckCollaterals();
+    BOOST_CHECK(!man.IsCollateralSpent(mn3.vin.prevout));
+
+    // a spend in a block is undone by disconnecting the block
+    CBlock block;
+    block.vtx.push_back(tx1);
+    GetMainSignals().SyncTransaction(tx1, &block);
+    BOOST_CHECK(man.IsCollateralSpent(mn1.vin.prevout));
+    GetMainSignals().SyncTransaction(tx1, NULL);
+    man.CheckCollaterals();
+    BOOST_CHECK(!man.IsCollateralSpent(mn1.vin.prevout));
+
+    // a removed masternode is no longer tracked
+    GetMainSignals().SyncTransaction(tx1, &block);
+    man.Remove(mn1.vin);
+    BOOST_CHECK(!man.IsCollateralSpent(mn1.vin.prevout));
+
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(mn1.vin.prevout.hash)->Clear();
+        pcoinsTip->ModifyCoins(mn3.vin.prevout.hash)->Clear();
+    }
+    UnregisterValidationInterface(&man);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_payments_last_voted)
+{
+    CScript payee1 = GetScriptForDestination(NewPubKey().GetID());
+    CScript payee2 = GetScriptForDestination(NewPubKey().GetID());
+
+    CMasternodePayments payments;
+    for (int nHeight = 100; nHeight < 200; nHeight += 10) {
+        CMasternodeBlockPayees blockPayees(nHeight);
+        blockPayees.AddPayee(payee1, nHeight < 150 ? 3 : 1);
+        blockPayees.AddPayee(payee2, 2);
+        payments.mapMasternodeBlocks[nHeight] = blockPayees;
+    }
+
+    // the voted heights are indexed when the payments are loaded
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << payments;
+    CMasternodePayments loaded;
+    ss >> loaded;
+
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee1, 0, 1000), 140);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee1, 0, 135), 130);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee1, 140, 1000), -1);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee2, 0, 1000), 190);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee2, 189, 190), 190);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee2, 0, 99), -1);
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(GetScriptForDestination(NewPubKey().GetID()), 0, 1000), -1);
+
+    loaded.Clear();
+    BOOST_CHECK_EQUAL(loaded.GetLastVotedHeight(payee2, 0, 1000), -1);
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_score_ranks)
+{
+    CMasternodeMan man;
+    const int nHeight = 1000;
+    mapCacheBlockHashes[nHeight] = GetRandHash();
+    mapCacheBlockHashes[nHeight + 1] = GetRandHash();
+
+    std::vector<CTxIn> vin;
+    for (int i = 0; i < 20; i++) {
+        CMasternode mn = NewMasternode(NewPubKey());
+        mn.sigTime = GetAdjustedTime() - 24 * 60 * 60; // old enough to be ranked
+        BOOST_CHECK(man.Add(mn));
+        vin.push_back(mn.vin);
+    }
+
+    // ranks are a permutation of 1..n ordered by descending score, and stay so across lookups
+    for (int nRound = 0; nRound < 2; nRound++) {
+        int64_t nLastScore = std::numeric_limits<int64_t>::max();
+        for (int nRank = 1; nRank <= 20; nRank++) {
+            CMasternode* pmn = man.GetMasternodeByRank(nRank, nHeight, 0, false);
+            BOOST_REQUIRE(pmn != NULL);
+            BOOST_CHECK_EQUAL(man.GetMasternodeRank(pmn->vin, nHeight, 0, false), nRank);
+            int64_t nScore = pmn->CalculateScore(1, nHeight).GetCompact(false);
+            BOOST_CHECK(nScore <= nLastScore);
+            nLastScore = nScore;
+        }
+        BOOST_CHECK(man.GetMasternodeByRank(21, nHeight, 0, false) == NULL);
+    }
+
+    // every height has its own ordering
+    BOOST_CHECK(man.GetMasternodeByRank(1, nHeight + 1, 0, false) != NULL);
+    BOOST_CHECK_EQUAL(man.GetMasternodeRank(CTxIn(GetRandHash(), 0), nHeight, 0, false), -1);
+    BOOST_CHECK_EQUAL(man.GetMasternodeRank(vin[0], nHeight + 2, 0, false), -1);
+
+    // the cached order follows the list as it changes
+    man.Remove(vin[0]);
+    BOOST_CHECK_EQUAL(man.GetMasternodeRank(vin[0], nHeight, 0, false), -1);
+    BOOST_CHECK(man.GetMasternodeByRank(20, nHeight, 0, false) == NULL);
+    CMasternode mn = NewMasternode(NewPubKey());
+    mn.sigTime = GetAdjustedTime() - 24 * 60 * 60; // old enough to be ranked
+    BOOST_CHECK(man.Add(mn));
+    BOOST_CHECK(man.GetMasternodeRank(mn.vin, nHeight, 0, false) > 0);
+    BOOST_CHECK(man.GetMasternodeByRank(20, nHeight, 0, false) != NULL);
+
+    mapCacheBlockHashes.erase(nHeight);
+    mapCacheBlockHashes.erase(nHeight + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "util.h"
 
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <list>
 
 BOOST_AUTO_TEST_SUITE(mempool_tests)
@@ -99,4 +100,314 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // tx1 pays the highest fee rate, tx2 the lowest and tx3 spends tx2
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 100, 0.0, 1));
+
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 1000LL, 200, 0.0, 1));
+
+    CMutableTransaction tx3;
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 5000LL, 300, 0.0, 1));
+
+    // the usage goes down as transactions go away
+    size_t nUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+    pool.TrimToSize(nUsage);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+
+    // the lowest fee rate goes first, along with its descendant
+    pool.TrimToSize(nUsage - 1);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+    BOOST_CHECK(!pool.exists(tx3.GetHash()));
+    BOOST_CHECK(pool.DynamicMemoryUsage() < nUsage);
+
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+
+    // expiry removes the old transactions with their descendants
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 100, 0.0, 1));
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 1000LL, 200, 0.0, 1));
+    pool.addUnchecked(tx3.GetHash(), CTxMemPoolEntry(tx3, 5000LL, 300, 0.0, 1));
+    BOOST_CHECK_EQUAL(pool.Expire(100), 0);
+    BOOST_CHECK_EQUAL(pool.Expire(201), 3);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMinFeeTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    SetMockTime(42);
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 100, 0.0, 1));
+
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 1000LL, 200, 0.0, 1));
+
+    // no floor until something was evicted
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // the evicted transactions are handed back, and the floor is one relay fee above them
+    std::list<CTransaction> removed;
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, &removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(removed.front().GetHash() == tx2.GetHash());
+    CAmount nMinFee = CFeeRate(1000LL, ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION)).GetFeePerK() + 1000;
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee);
+
+    // it only decays once a block came in
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(std::vector<CTransaction>(), 1, conflicts);
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFee / 2);
+
+    // and goes away once it is below half the relay fee
+    SetMockTime(42 + 10 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    removed.clear();
+    BOOST_CHECK_EQUAL(pool.Expire(101, &removed), 1);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(removed.front().GetHash() == tx1.GetHash());
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorDescendantTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // txParent <- txChild <- txGrandChild, and txSibling also spends txParent
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 10 * COIN;
+    }
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txSibling;
+    txSibling.vin.resize(1);
+    txSibling.vin[0].prevout = COutPoint(txParent.GetHash(), 1);
+    txSibling.vin[0].scriptSig = CScript() << OP_12;
+    txSibling.vout.resize(1);
+    txSibling.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    txSibling.vout[0].nValue = 10 * COIN;
+
+    CTxMemPoolEntry entryParent(txParent, 1000LL, 100, 0.0, 1);
+    CTxMemPoolEntry entryChild(txChild, 2000LL, 200, 0.0, 1);
+    CTxMemPoolEntry entryGrandChild(txGrandChild, 30000LL, 300, 0.0, 1);
+    CTxMemPoolEntry entrySibling(txSibling, 4000LL, 400, 0.0, 1);
+    uint64_t nParentSize = entryParent.GetTxSize();
+    uint64_t nChildSize = entryChild.GetTxSize();
+    uint64_t nGrandChildSize = entryGrandChild.GetTxSize();
+    uint64_t nSiblingSize = entrySibling.GetTxSize();
+
+    pool.addUnchecked(txParent.GetHash(), entryParent);
+    pool.addUnchecked(txChild.GetHash(), entryChild);
+    pool.addUnchecked(txGrandChild.GetHash(), entryGrandChild);
+    pool.addUnchecked(txSibling.GetHash(), entrySibling);
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    CTxMemPool::txiter itGrandChild = pool.mapTx.find(txGrandChild.GetHash());
+    CTxMemPool::txiter itSibling = pool.mapTx.find(txSibling.GetHash());
+
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itParent->GetSizeWithDescendants(), nParentSize + nChildSize + nGrandChildSize + nSiblingSize);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 37000LL);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(itChild->GetModFeesWithDescendants(), 32000LL);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), nParentSize + nChildSize + nGrandChildSize);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 33000LL);
+    BOOST_CHECK_EQUAL(itSibling->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itSibling->GetModFeesWithAncestors(), 5000LL);
+
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itParent).size(), 2);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolParents(itGrandChild).size(), 1);
+    CTxMemPool::setEntries setAncestors;
+    pool.CalculateMemPoolAncestors(*itGrandChild, setAncestors);
+    BOOST_CHECK_EQUAL(setAncestors.size(), 2);
+
+    // The package of the grandchild pays the best fee rate, the parent alone the worst
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator it = pool.mapTx.get<ancestor_score>().begin();
+    BOOST_CHECK(it->GetTx().GetHash() == txGrandChild.GetHash());
+    BOOST_CHECK(pool.mapTx.get<ancestor_score>().rbegin()->GetTx().GetHash() == txParent.GetHash());
+
+    // A fee delta is propagated to both sides
+    pool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 0.0, 500LL);
+    BOOST_CHECK_EQUAL(itChild->GetModifiedFee(), 2500LL);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 37500LL);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 33500LL);
+    BOOST_CHECK_EQUAL(itSibling->GetModFeesWithAncestors(), 5000LL);
+
+    // Removing the parent, as when it is mined, leaves the descendants with fewer ancestors
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 32500LL);
+    BOOST_CHECK_EQUAL(itSibling->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolParents(itChild).size(), 0);
+
+    // Adding it back, as when its block is disconnected, links the descendants again
+    pool.addUnchecked(txParent.GetHash(), entryParent);
+    itParent = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 37500LL);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), nParentSize + nChildSize + nGrandChildSize);
+    BOOST_CHECK_EQUAL(itSibling->GetCountWithAncestors(), 2);
+
+    // Recursive removal of the child takes the grandchild along and updates the parent
+    removed.clear();
+    pool.remove(txChild, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(itParent->GetSizeWithDescendants(), nParentSize + nSiblingSize);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 5000LL);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itParent).size(), 1);
+
+    removed.clear();
+    pool.remove(txParent, removed, true);
+    pool.ClearPrioritisation(txChild.GetHash());
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPackageLimitsTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    const uint64_t nSizeLimit = DEFAULT_ANCESTOR_SIZE_LIMIT * 1000;
+
+    // A chain of one more transaction than the default limits, each spending the previous one
+    std::vector<CMutableTransaction> chain(DEFAULT_ANCESTOR_LIMIT + 1);
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].vin.resize(1);
+        if (i > 0)
+            chain[i].vin[0].prevout = COutPoint(chain[i - 1].GetHash(), 0);
+        chain[i].vin[0].scriptSig = CScript() << OP_11;
+        chain[i].vout.resize(1);
+        chain[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        chain[i].vout[0].nValue = 10 * COIN;
+    }
+
+    // Up to the limit every transaction is accepted and linked to all its ancestors
+    std::string errString;
+    for (unsigned int i = 0; i < DEFAULT_ANCESTOR_LIMIT; i++) {
+        CTxMemPoolEntry entry(chain[i], 1000LL, 0, 0.0, 1);
+        CTxMemPool::setEntries setAncestors;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(entry, setAncestors, DEFAULT_ANCESTOR_LIMIT, nSizeLimit,
+                                                   DEFAULT_DESCENDANT_LIMIT, nSizeLimit, errString));
+        BOOST_CHECK_EQUAL(setAncestors.size(), i);
+        pool.addUnchecked(chain[i].GetHash(), entry);
+    }
+    BOOST_CHECK_EQUAL(pool.size(), DEFAULT_ANCESTOR_LIMIT);
+    CTxMemPool::txiter itRoot = pool.mapTx.find(chain[0].GetHash());
+    CTxMemPool::txiter itTip = pool.mapTx.find(chain[DEFAULT_ANCESTOR_LIMIT - 1].GetHash());
+    BOOST_CHECK_EQUAL(itRoot->GetCountWithDescendants(), DEFAULT_ANCESTOR_LIMIT);
+    BOOST_CHECK_EQUAL(itTip->GetCountWithAncestors(), DEFAULT_ANCESTOR_LIMIT);
+    BOOST_CHECK_EQUAL(itRoot->GetModFeesWithDescendants(), 1000LL * DEFAULT_ANCESTOR_LIMIT);
+
+    // One more is refused, on the ancestor count or on the descendants of the root
+    CTxMemPoolEntry entryOver(chain.back(), 1000LL, 0, 0.0, 1);
+    CTxMemPool::setEntries setAncestors;
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryOver, setAncestors, DEFAULT_ANCESTOR_LIMIT, nSizeLimit,
+                                                DEFAULT_DESCENDANT_LIMIT, nSizeLimit, errString));
+    BOOST_CHECK(errString.find("too many unconfirmed ancestors") == 0);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryOver, setAncestors, nNoLimit, nSizeLimit,
+                                                DEFAULT_DESCENDANT_LIMIT, nSizeLimit, errString));
+    BOOST_CHECK(errString.find("too many descendants for tx " + chain[0].GetHash().ToString()) == 0);
+
+    // The size limits count the transaction itself with its ancestors or descendants
+    uint64_t nTxSize = entryOver.GetTxSize();
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryOver, setAncestors, nNoLimit, nTxSize * DEFAULT_ANCESTOR_LIMIT,
+                                                nNoLimit, nSizeLimit, errString));
+    BOOST_CHECK(errString.find("exceeds ancestor size limit") == 0);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryOver, setAncestors, nNoLimit, nSizeLimit,
+                                                nNoLimit, nTxSize * DEFAULT_ANCESTOR_LIMIT, errString));
+    BOOST_CHECK(errString.find("exceeds descendant size limit") == 0);
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryOver, setAncestors, nNoLimit, nSizeLimit,
+                                               nNoLimit, nSizeLimit, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), DEFAULT_ANCESTOR_LIMIT);
+
+    // Once the root is mined the chain is one shorter and the last transaction fits
+    std::list<CTransaction> removed;
+    pool.remove(chain[0], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(itTip->GetCountWithAncestors(), DEFAULT_ANCESTOR_LIMIT - 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[1].GetHash())->GetCountWithDescendants(), DEFAULT_ANCESTOR_LIMIT - 1);
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryOver, setAncestors, DEFAULT_ANCESTOR_LIMIT, nSizeLimit,
+                                               DEFAULT_DESCENDANT_LIMIT, nSizeLimit, errString));
+    pool.addUnchecked(chain.back().GetHash(), entryOver);
+    BOOST_CHECK_EQUAL(pool.size(), DEFAULT_ANCESTOR_LIMIT);
+
+    // Removing the new root recursively takes the whole chain along
+    removed.clear();
+    pool.remove(chain[1], removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), DEFAULT_ANCESTOR_LIMIT);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
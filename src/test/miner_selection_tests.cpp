@@ -0,0 +1,120 @@
+// Copyright (c) 2020 The powerbalt developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "miner.h"
+#include "txmempool.h"
+#include "test/test_pwrb.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(miner_selection_tests, TestingSetup)
+
+/** Add an anyone-can-spend output of nValue to the coins tip */
+static COutPoint AddCoin(CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    tx.vout.emplace_back(nValue, CScript() << OP_TRUE);
+    pcoinsTip->ModifyCoins(tx.GetHash())->FromTx(tx, 0);
+    return COutPoint(tx.GetHash(), 0);
+}
+
+/** Spend prevout of nValueIn, paying nFee, and add the transaction to the mempool */
+static CTransaction AddTx(const COutPoint& prevout, CAmount nValueIn, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.emplace_back(nValueIn - nFee, CScript() << OP_TRUE);
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, GetTime(), 0.0, 1));
+    return tx;
+}
+
+/** The block size limit that leaves room for nTxs of the transactions above */
+static unsigned int RoomFor(const CTransaction& tx, unsigned int nTxs)
+{
+    return 1000 + nTxs * ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) + 1;
+}
+
+static void CheckSelection(const std::vector<CTransaction>& vtx, const std::vector<CTransaction>& vExpected)
+{
+    BOOST_CHECK_EQUAL(vtx.size(), vExpected.size());
+    for (unsigned int i = 0; i < vtx.size() && i < vExpected.size(); i++)
+        BOOST_CHECK(vtx[i].GetHash() == vExpected[i].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(selection_follows_the_mempool)
+{
+    mempool.clear();
+    const int nHeight = chainActive.Height() + 1;
+    const unsigned int nMaxSize = DEFAULT_BLOCK_MAX_SIZE;
+
+    BOOST_CHECK(GetBlockTxSelection(nHeight, nMaxSize, 0, 0).empty());
+
+    const CTransaction txA = AddTx(AddCoin(10 * COIN), 10 * COIN, CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txA});
+
+    // New transactions are ranked with the previously selected ones
+    const CTransaction txB = AddTx(AddCoin(10 * COIN), 10 * COIN, 2 * CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txB, txA});
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txB, txA});
+
+    // A child follows its parent
+    const CTransaction txChild = AddTx(COutPoint(txA.GetHash(), 0), txA.vout[0].nValue, CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txB, txA, txChild});
+
+    // Transactions that left the mempool are dropped with their descendants
+    std::list<CTransaction> removed;
+    mempool.remove(txA, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2U);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txB});
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(selection_replaces_worse_transactions)
+{
+    mempool.clear();
+    const int nHeight = chainActive.Height() + 1;
+
+    const CTransaction txA = AddTx(AddCoin(10 * COIN), 10 * COIN, CENT);
+    const CTransaction txB = AddTx(AddCoin(10 * COIN), 10 * COIN, 2 * CENT);
+    const unsigned int nMaxSize = RoomFor(txA, 2);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txB, txA});
+
+    // The block is full, a better paying transaction takes the place of the worst selected one
+    const CTransaction txC = AddTx(AddCoin(10 * COIN), 10 * COIN, 3 * CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txC, txB});
+
+    // prioritisetransaction reranks the selection
+    mempool.PrioritiseTransaction(txA.GetHash(), txA.GetHash().ToString(), 0, 5 * CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txA, txC});
+    mempool.ClearPrioritisation(txA.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(selection_by_package)
+{
+    mempool.clear();
+    const int nHeight = chainActive.Height() + 1;
+
+    // A free parent is selected for the fee of its child, before a transaction paying more than
+    // the parent but less than the package
+    const CTransaction txParent = AddTx(AddCoin(10 * COIN), 10 * COIN, 0);
+    const CTransaction txOther = AddTx(AddCoin(10 * COIN), 10 * COIN, CENT);
+    const unsigned int nMaxSize = RoomFor(txParent, 2);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txOther});
+
+    const CTransaction txChild = AddTx(COutPoint(txParent.GetHash(), 0), txParent.vout[0].nValue, 4 * CENT);
+    CheckSelection(GetBlockTxSelection(nHeight, nMaxSize, 0, 0), {txParent, txChild});
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
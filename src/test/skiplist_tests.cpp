@@ -102,4 +102,36 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(accumulator_checkpoint_test)
+{
+    // The checkpoint changes every 10 blocks, the entries share the pooled values
+    size_t nPooled = CBlockIndex::CountAccumulatorCheckpoints();
+    size_t nUsage = CBlockIndex::DynamicAccumulatorCheckpointsUsage();
+    std::vector<CBlockIndex> vIndex(100);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vIndex[i].nVersion = 5;
+        vIndex[i].SetAccumulatorCheckpoint(ArithToUint256(arith_uint256(1000 + i / 10)));
+    }
+    BOOST_CHECK_EQUAL(CBlockIndex::CountAccumulatorCheckpoints(), nPooled + 10);
+    BOOST_CHECK(CBlockIndex::DynamicAccumulatorCheckpointsUsage() < nUsage + 100 * sizeof(uint256));
+    BOOST_CHECK(vIndex[10].pAccumulatorCheckpoint == vIndex[19].pAccumulatorCheckpoint);
+    BOOST_CHECK(vIndex[9].pAccumulatorCheckpoint != vIndex[10].pAccumulatorCheckpoint);
+    BOOST_CHECK(vIndex[42].GetAccumulatorCheckpoint() == ArithToUint256(arith_uint256(1004)));
+    BOOST_CHECK(vIndex[42].GetBlockHeader().nAccumulatorCheckpoint == ArithToUint256(arith_uint256(1004)));
+
+    // Copies keep the value, with no entry to clean up when they go away
+    {
+        CBlockIndex indexCopy(vIndex[42]);
+        BOOST_CHECK(indexCopy.GetAccumulatorCheckpoint() == vIndex[42].GetAccumulatorCheckpoint());
+        indexCopy.SetAccumulatorCheckpoint(UINT256_ZERO);
+        BOOST_CHECK(indexCopy.GetAccumulatorCheckpoint().IsNull());
+    }
+    BOOST_CHECK(vIndex[42].GetAccumulatorCheckpoint() == ArithToUint256(arith_uint256(1004)));
+    BOOST_CHECK_EQUAL(CBlockIndex::CountAccumulatorCheckpoints(), nPooled + 10);
+
+    // Only versions 4 to 6 have a checkpoint
+    vIndex[42].nVersion = 7;
+    BOOST_CHECK(vIndex[42].GetAccumulatorCheckpoint().IsNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
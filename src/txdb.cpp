@@ -8,6 +8,7 @@
 
 #include "txdb.h"
 
+#include "blockfilter.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
@@ -224,6 +225,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
+                // The key is trusted to be the hash of the header, -checkblockindex re-checks a sample
+                diskindex.hashBlock = key.second;
+
                 // Construct block index object
                 CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
                 pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
@@ -240,7 +244,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nTx = diskindex.nTx;
 
                 //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+                pindexNew->SetAccumulatorCheckpoint(diskindex.nAccumulatorCheckpoint);
 
                 //Proof Of Stake
                 pindexNew->nFlags = diskindex.nFlags;
@@ -437,3 +441,197 @@ bool CZerocoinDB::WipeAccChecksums()
     LogPrintf("%s: AccChecksum database removed.\n", __func__);
     return true;
 }
+
+// Lotto bet database
+static const char DB_BET = 'b';
+static const char DB_BET_PAYOUT = 'p';
+static const char DB_BET_BEST_BLOCK = 'B';
+
+/** Big-endian height, so that payout records iterate in chain order */
+struct CBetHeightKey {
+    uint32_t nHeight;
+
+    explicit CBetHeightKey(uint32_t nHeightIn = 0) : nHeight(nHeightIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata32be(s, nHeight);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        nHeight = ser_readdata32be(s);
+    }
+};
+
+CBetDB::CBetDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "betting", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBetDB::WriteBlockBets(const CBlockIndex* pindex, const std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets, const std::vector<CTxOut>& vPaid)
+{
+    CDBBatch batch;
+    for (const auto& bet : vBets)
+        batch.Write(std::make_pair(DB_BET, bet.first), bet.second);
+
+    CBetHeightKey heightKey(pindex->nHeight);
+    if (!vPaid.empty()) {
+        CBetPayoutRecord record;
+        record.hashBlock = pindex->GetBlockHash();
+        record.nBlockTime = pindex->GetBlockTime();
+        record.vPaid = vPaid;
+        batch.Write(std::make_pair(DB_BET_PAYOUT, heightKey), record);
+    } else {
+        // drop the record of a block previously connected at this height, if any
+        batch.Erase(std::make_pair(DB_BET_PAYOUT, heightKey));
+    }
+    batch.Write(DB_BET_BEST_BLOCK, pindex->GetBlockHash());
+
+    if (!vBets.empty() || !vPaid.empty())
+        LogPrint(BCLog::BETTING, "Writing %u bets and %u bet payouts of block %d to db.\n", vBets.size(), vPaid.size(), pindex->nHeight);
+    // No sync: the index is rebuilt at startup if it falls behind the chain tip
+    return WriteBatch(batch);
+}
+
+bool CBetDB::EraseBlockBets(const CBlockIndex* pindex, const std::vector<CBetIndexKey>& vKeys)
+{
+    CDBBatch batch;
+    for (const CBetIndexKey& key : vKeys)
+        batch.Erase(std::make_pair(DB_BET, key));
+    batch.Erase(std::make_pair(DB_BET_PAYOUT, CBetHeightKey(pindex->nHeight)));
+    if (pindex->pprev)
+        batch.Write(DB_BET_BEST_BLOCK, pindex->pprev->GetBlockHash());
+
+    return WriteBatch(batch);
+}
+
+bool CBetDB::ReadDrawBets(uint32_t nDate, int nHeightStart, int nHeightEnd, std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_BET, CBetIndexKey(nDate, std::max(nHeightStart, 0), 0, 0)));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CBetIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BET || key.second.nDate != nDate || (int)key.second.nHeight > nHeightEnd)
+            break;
+
+        CBetIndexEntry entry;
+        if (!pcursor->GetValue(entry))
+            return error("%s : failed to read value", __func__);
+        vBets.emplace_back(key.second, entry);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBetDB::ReadBetPayouts(int nHeightStart, int nHeightEnd, std::vector<std::pair<int, CBetPayoutRecord> >& vPayouts)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_BET_PAYOUT, CBetHeightKey(std::max(nHeightStart, 0))));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CBetHeightKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BET_PAYOUT || (int)key.second.nHeight > nHeightEnd)
+            break;
+
+        CBetPayoutRecord record;
+        if (!pcursor->GetValue(record))
+            return error("%s : failed to read value", __func__);
+        vPayouts.emplace_back(key.second.nHeight, record);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBetDB::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read(DB_BET_BEST_BLOCK, hashBlock);
+}
+
+// Block filter index
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_FILTER_NEXT_POS = 'P';
+static const char DB_FILTER_BEST_BLOCK = 'B';
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blockfilter", nCacheSize, fMemory, fWipe), fSynced(false)
+{
+    if (!Read(DB_FILTER_NEXT_POS, posNext))
+        posNext = CDiskBlockPos(0, 0);
+}
+
+bool CBlockFilterDB::WriteFilter(const BlockFilter& filter, const uint256& hashHeader)
+{
+    const std::vector<unsigned char>& vEncoded = filter.GetEncodedFilter();
+    unsigned int nSize = ::GetSerializeSize(vEncoded, SER_DISK, CLIENT_VERSION);
+    if (posNext.nPos > 0 && posNext.nPos + nSize > MAX_FILTERFILE_SIZE) {
+        posNext.nFile++;
+        posNext.nPos = 0;
+    }
+    if (!CheckDiskSpace(nSize))
+        return error("%s : out of disk space", __func__);
+
+    CBlockFilterIndexEntry entry;
+    entry.pos = posNext;
+    entry.hashFilter = filter.GetHash();
+    entry.hashHeader = hashHeader;
+    {
+        CAutoFile fileout(OpenFilterFile(entry.pos), SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s : OpenFilterFile failed", __func__);
+        fileout << vEncoded;
+    }
+    posNext.nPos += nSize;
+
+    // No sync: a filter missing after a crash only means that rescans read that block
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_FILTER, filter.GetBlockHash()), entry);
+    batch.Write(DB_FILTER_NEXT_POS, posNext);
+    batch.Write(DB_FILTER_BEST_BLOCK, filter.GetBlockHash());
+    return WriteBatch(batch);
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, BlockFilter& filter) const
+{
+    CBlockFilterIndexEntry entry;
+    if (!Read(std::make_pair(DB_BLOCK_FILTER, hashBlock), entry))
+        return false;
+
+    CAutoFile filein(OpenFilterFile(entry.pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenFilterFile failed", __func__);
+
+    try {
+        std::vector<unsigned char> vEncoded;
+        filein >> vEncoded;
+        filter = BlockFilter(hashBlock, vEncoded);
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    if (filter.GetHash() != entry.hashFilter)
+        return error("%s : Checksum mismatch for block %s", __func__, hashBlock.GetHex());
+    return true;
+}
+
+bool CBlockFilterDB::ReadFilterHeader(const uint256& hashBlock, uint256& hashHeader) const
+{
+    CBlockFilterIndexEntry entry;
+    if (!Read(std::make_pair(DB_BLOCK_FILTER, hashBlock), entry))
+        return false;
+    hashHeader = entry.hashHeader;
+    return true;
+}
+
+bool CBlockFilterDB::HaveFilter(const uint256& hashBlock) const
+{
+    return Exists(std::make_pair(DB_BLOCK_FILTER, hashBlock));
+}
+
+bool CBlockFilterDB::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read(DB_FILTER_BEST_BLOCK, hashBlock);
+}
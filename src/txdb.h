@@ -13,11 +13,13 @@
 #include "main.h"
 #include "zpwrb/zerocoin.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+class BlockFilter;
 class CCoins;
 class uint256;
 
@@ -134,4 +136,148 @@ public:
     bool WipeAccChecksums();
 };
 
+/** Position of a lotto bet output. Fields are stored big-endian so that the
+ *  bets of a draw iterate in chain order (height, tx, output). */
+struct CBetIndexKey {
+    uint32_t nDate;
+    uint32_t nHeight;
+    uint32_t nTx;
+    uint32_t nOut;
+
+    CBetIndexKey() : nDate(0), nHeight(0), nTx(0), nOut(0) {}
+    CBetIndexKey(uint32_t nDateIn, uint32_t nHeightIn, uint32_t nTxIn, uint32_t nOutIn) :
+            nDate(nDateIn), nHeight(nHeightIn), nTx(nTxIn), nOut(nOutIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata32be(s, nDate);
+        ser_writedata32be(s, nHeight);
+        ser_writedata32be(s, nTx);
+        ser_writedata32be(s, nOut);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        nDate = ser_readdata32be(s);
+        nHeight = ser_readdata32be(s);
+        nTx = ser_readdata32be(s);
+        nOut = ser_readdata32be(s);
+    }
+};
+
+/** A lotto bet as placed on chain, with the payout script already resolved from the bet's first input */
+struct CBetIndexEntry {
+    uint256 hashBlock;
+    int64_t nBlockTime;
+    CAmount nBetValue;
+    uint32_t nNumber1;
+    uint32_t nNumber2;
+    uint32_t nNumber3;
+    CScript scriptPayout;
+
+    CBetIndexEntry() : nBlockTime(0), nBetValue(0), nNumber1(0), nNumber2(0), nNumber3(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nBlockTime);
+        READWRITE(nBetValue);
+        READWRITE(nNumber1);
+        READWRITE(nNumber2);
+        READWRITE(nNumber3);
+        READWRITE(*(CScriptBase*)(&scriptPayout));
+    }
+};
+
+/** The bet payouts made by the coinstake of one block */
+struct CBetPayoutRecord {
+    uint256 hashBlock;
+    int64_t nBlockTime;
+    std::vector<CTxOut> vPaid;
+
+    CBetPayoutRecord() : nBlockTime(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nBlockTime);
+        READWRITE(vPaid);
+    }
+};
+
+/** Lotto bet database (betting/) */
+class CBetDB : public CDBWrapper
+{
+public:
+    CBetDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBetDB(const CBetDB&);
+    void operator=(const CBetDB&);
+
+public:
+    /** Record the bets placed and bet payouts made in a block and move the best block to it */
+    bool WriteBlockBets(const CBlockIndex* pindex, const std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets, const std::vector<CTxOut>& vPaid);
+    /** Remove the records of a disconnected block and move the best block back to its parent */
+    bool EraseBlockBets(const CBlockIndex* pindex, const std::vector<CBetIndexKey>& vKeys);
+    /** Bets for draw nDate placed at heights [nHeightStart, nHeightEnd], in chain order */
+    bool ReadDrawBets(uint32_t nDate, int nHeightStart, int nHeightEnd, std::vector<std::pair<CBetIndexKey, CBetIndexEntry> >& vBets);
+    /** Bet payout records of heights [nHeightStart, nHeightEnd], in chain order */
+    bool ReadBetPayouts(int nHeightStart, int nHeightEnd, std::vector<std::pair<int, CBetPayoutRecord> >& vPayouts);
+    bool ReadBestBlock(uint256& hashBlock) const;
+};
+
+/** Location of a block filter in the fltr?????.dat files, with the filter hash and header */
+struct CBlockFilterIndexEntry {
+    CDiskBlockPos pos;
+    uint256 hashFilter;
+    uint256 hashHeader;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(pos);
+        READWRITE(hashFilter);
+        READWRITE(hashHeader);
+    }
+};
+
+/** Block filter index (blockfilter/), the filters themselves are stored in the fltr?????.dat files */
+class CBlockFilterDB : public CDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+
+    //! Where the next filter is appended, protected by cs_main
+    CDiskBlockPos posNext;
+    //! Whether every block of the active chain has a filter
+    std::atomic<bool> fSynced;
+
+public:
+    /** Append a block filter to the filter files and index it with its header. Requires cs_main. */
+    bool WriteFilter(const BlockFilter& filter, const uint256& hashHeader);
+    bool ReadFilter(const uint256& hashBlock, BlockFilter& filter) const;
+    bool ReadFilterHeader(const uint256& hashBlock, uint256& hashHeader) const;
+    bool HaveFilter(const uint256& hashBlock) const;
+    //! The block of the last filter written, all its ancestors have one too
+    bool ReadBestBlock(uint256& hashBlock) const;
+
+    bool IsSynced() const { return fSynced; }
+    void SetSynced() { fSynced = true; }
+};
+
 #endif // BITCOIN_TXDB_H
@@ -4563,28 +4563,36 @@ UniValue spendrawzerocoin(const UniValue& params, bool fHelp)
 
 UniValue listbets(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 2)
+    if (fHelp || params.size() > 3)
         throw std::runtime_error(
-            "listbets ( \"account\" count)\n"
-            "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
+            "listbets ( \"account\" count from )\n"
+            "\nReturns up to 'count' most recent bets skipping the first 'from' bets.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
-            "2. count          (numeric, optional, default=10) The number of transactions to return\n"
+            "2. count          (numeric, optional, default=10) The number of bets to return\n"
+            "3. from           (numeric, optional, default=0) The number of bets to skip\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
-            "    \"tx-id\":\"accountname\",       (string) The ID (date) of the event being bet on.\n"
+            "    \"tx-id\":\"transactionid\",    (string) The transaction id of the bet.\n"
+            "    \"vout\": n,                    (numeric) The output index of the bet.\n"
             "    \"event-id\":\"drawdate\",       (string) The ID (date) of the event being bet on.\n"
             "    \"number1\":\"selectednumber\",  (string) The first number selected.\n"
             "    \"number2\":\"selectednumber\",  (string) The second number selected.\n"
             "    \"number3\":\"selectednumber\",  (string) The third number selected.\n"
             "    \"amount\": x.xxx,               (numeric) The amount bet in PWR.\n"
+            "    \"status\":\"status\",           (string) \"pending\" until the draw is paid out, then \"paid\", \"lost\" or \"unknown\".\n"
+            "    \"payout\": x.xxx,               (numeric) The amount paid in PWR, for a paid bet.\n"
+            "    \"payout-txid\":\"transactionid\", (string) The coinstake that paid the bet, for a paid bet.\n"
+            "    \"confirmations\": n,           (numeric) The confirmations of the payout, for a paid bet.\n"
             "  }\n"
             "]\n"
 
             "\nExamples:\n"
             "\nList the most recent 10 bets in the systems\n" +
-            HelpExampleCli("listbets", ""));
+            HelpExampleCli("listbets", "") +
+            "\nList bets 100 to 120\n" +
+            HelpExampleCli("listbets", "\"*\" 20 100"));
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
@@ -4597,10 +4605,6 @@ UniValue listbets(const UniValue& params, bool fHelp)
     int nFrom = 0;
     if (params.size() > 2)
         nFrom = params[2].get_int();
-    isminefilter filter = ISMINE_SPENDABLE;
-    if (params.size() > 3)
-        if (params[3].get_bool())
-            filter = filter | ISMINE_WATCH_ONLY;
 
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
@@ -4609,65 +4613,29 @@ UniValue listbets(const UniValue& params, bool fHelp)
 
     UniValue ret(UniValue::VARR);
 
-    const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0) {
-
-            uint256 txHash = (*pwtx).GetHash();
-
-            for (unsigned int i = 0; i < (*pwtx).vout.size(); i++) {
-                const CTxOut& txout = (*pwtx).vout[i];
-                std::string scriptPubKey = ScriptToAsmStr(txout.scriptPubKey);
-
-                // TODO Remove hard-coded values from this block.
-                if (scriptPubKey.length() > 0 && strncmp(scriptPubKey.c_str(), "OP_RETURN", 9) == 0) {
-                    std::vector<unsigned char> vOpCode = ParseHex(scriptPubKey.substr(9, std::string::npos));
-                    std::string opCode(vOpCode.begin(), vOpCode.end());
-
-                    CLottoBet lottoBet;
-                    if (CLottoBet::FromOpCode(opCode, lottoBet)) {
-                        UniValue entry(UniValue::VOBJ);
-                        entry.push_back(Pair("tx-id", txHash.ToString().c_str()));
-                        entry.push_back(Pair("event-id", (uint64_t) lottoBet.nDate));
-                        entry.push_back(Pair("number1", (uint64_t) lottoBet.nNumber3));
-                        entry.push_back(Pair("number2", (uint64_t) lottoBet.nNumber2));
-                        entry.push_back(Pair("number3", (uint64_t) lottoBet.nNumber1));
-                        entry.push_back(Pair("amount", ValueFromAmount(txout.nValue)));
-
-                        ret.push_back(entry);
-                    }
-                }
-            }
+    // Oldest to newest
+    for (const CWalletBet& bet : pwalletMain->ListWalletBets(nCount, nFrom)) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("tx-id", bet.outpoint.hash.ToString()));
+        entry.push_back(Pair("vout", (int)bet.outpoint.n));
+        entry.push_back(Pair("event-id", (uint64_t) bet.nDate));
+        entry.push_back(Pair("number1", (uint64_t) bet.nNumber3));
+        entry.push_back(Pair("number2", (uint64_t) bet.nNumber2));
+        entry.push_back(Pair("number3", (uint64_t) bet.nNumber1));
+        entry.push_back(Pair("amount", ValueFromAmount(bet.nBetValue)));
+        entry.push_back(Pair("status", bet.GetStatusString()));
+        if (bet.nStatus == CWalletBet::BET_PAID) {
+            entry.push_back(Pair("payout", ValueFromAmount(bet.nPayout)));
+            entry.push_back(Pair("payout-txid", bet.txidPayout.ToString()));
+            BlockMap::const_iterator mi = mapBlockIndex.find(bet.hashSettleBlock);
+            int nConfirmations = 0;
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+                nConfirmations = chainActive.Height() - mi->second->nHeight + 1;
+            entry.push_back(Pair("confirmations", nConfirmations));
         }
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+        ret.push_back(entry);
     }
 
-    // ret is newest to oldest
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-
-    std::vector<UniValue> arrTmp = ret.getValues();
-
-    std::vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    std::vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
-
-    std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
-
-    ret.clear();
-    ret.setArray();
-    ret.push_backV(arrTmp);
-
     return ret;
 }
 
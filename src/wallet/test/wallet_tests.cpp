@@ -7,6 +7,12 @@
 
 #include "wallet/wallet.h"
 
+#include "betting/bet.h"
+#include "main.h"
+#include "utilstrencodings.h"
+#include "wallet/walletdb.h"
+
+#include <algorithm>
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -306,4 +312,193 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(bnb_selection_tests)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(pwalletMain->cs_wallet);
+
+    // change below this is added to the fee, so a selection that close to the target needs no change output
+    const CAmount nMinChange = 3 * ::minRelayTxFee.GetFee(34 + 148);
+
+    empty_wallet();
+    add_coin( 7*CENT);
+    add_coin(11*CENT);
+    add_coin(13*CENT);
+    add_coin(17*CENT);
+    add_coin(19*CENT);
+    add_coin(23*CENT);
+    add_coin( 1*COIN);
+
+    // 7+13+19 is the only subset within the change-less window
+    BOOST_CHECK(pwalletMain->SelectCoinsMinConf(39 * CENT - nMinChange / 2, 1, 1, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 39 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    // the same target with non-dust change left over is not an exact match
+    BOOST_CHECK(pwalletMain->SelectCoinsMinConf(39 * CENT - 2 * nMinChange, 1, 1, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_GE(nValueRet, 39 * CENT - 2 * nMinChange);
+
+    // the exact match doesn't depend on the order of the coins
+    std::reverse(vCoins.begin(), vCoins.end());
+    BOOST_CHECK(pwalletMain->SelectCoinsMinConf(39 * CENT - nMinChange / 2, 1, 1, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 39 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    // many equal coins: the exact match is found without exploring every subset
+    empty_wallet();
+    for (int i = 0; i < 1000; i++)
+        add_coin(COIN);
+    add_coin(5 * CENT);
+    BOOST_CHECK(pwalletMain->SelectCoinsMinConf(500 * COIN + 5 * CENT, 1, 1, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 500 * COIN + 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 501U);
+
+    empty_wallet();
+}
+
+static CScript BetScript(const CLottoBet& lb)
+{
+    std::string opCode;
+    BOOST_CHECK(CLottoBet::ToOpCode(lb, opCode));
+    return CScript() << OP_RETURN << ParseHex(opCode);
+}
+
+static void CheckBet(const CWalletBet& bet, const COutPoint& outpoint, int nStatus)
+{
+    BOOST_CHECK(bet.outpoint == outpoint);
+    BOOST_CHECK_EQUAL(bet.nStatus, nStatus);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_bets_tests)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKey(key));
+    const CScript scriptPayout = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFunding.vout.emplace_back(20 * COIN, scriptPayout);
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txFunding), false, &walletdb));
+
+    // Three bets paid to the address of the funding output: a winner and a loser on the
+    // draw of 2020-06-03, and a bet on a later draw
+    CMutableTransaction txBets;
+    txBets.vin.resize(1);
+    txBets.vin[0].prevout = COutPoint(txFunding.GetHash(), 0);
+    txBets.vout.emplace_back(COIN, BetScript(CLottoBet(20200603, 7, 0, 0)));
+    txBets.vout.emplace_back(COIN, BetScript(CLottoBet(20200603, 5, 6, 0)));
+    txBets.vout.emplace_back(COIN, BetScript(CLottoBet(20200610, 7, 0, 0)));
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txBets), false, &walletdb));
+
+    // A bet whose first input isn't ours, so its payout can't be recognized
+    CMutableTransaction txUnknown;
+    txUnknown.vin.resize(1);
+    txUnknown.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txUnknown.vout.emplace_back(COIN, BetScript(CLottoBet(20200603, 7, 0, 0)));
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txUnknown), false, &walletdb));
+
+    // Recording, oldest to newest
+    std::vector<CWalletBet> vBets = pwalletMain->ListWalletBets(10, 0);
+    BOOST_CHECK_EQUAL(vBets.size(), 4U);
+    if (vBets.size() != 4U)
+        return;
+    CheckBet(vBets[0], COutPoint(txBets.GetHash(), 0), CWalletBet::BET_PENDING);
+    CheckBet(vBets[1], COutPoint(txBets.GetHash(), 1), CWalletBet::BET_PENDING);
+    CheckBet(vBets[2], COutPoint(txBets.GetHash(), 2), CWalletBet::BET_PENDING);
+    CheckBet(vBets[3], COutPoint(txUnknown.GetHash(), 0), CWalletBet::BET_PENDING);
+    BOOST_CHECK(vBets[0].scriptPayout == scriptPayout);
+    BOOST_CHECK(vBets[3].scriptPayout.empty());
+    BOOST_CHECK_EQUAL(vBets[1].nDate, 20200603U);
+    BOOST_CHECK_EQUAL(vBets[1].nNumber1, 5U);
+    BOOST_CHECK_EQUAL(vBets[1].nNumber2, 6U);
+    BOOST_CHECK_EQUAL(vBets[1].nBetValue, COIN);
+
+    // Paging counts back from the newest bet
+    vBets = pwalletMain->ListWalletBets(2, 0);
+    BOOST_CHECK_EQUAL(vBets.size(), 2U);
+    if (vBets.size() == 2U) {
+        CheckBet(vBets[0], COutPoint(txBets.GetHash(), 2), CWalletBet::BET_PENDING);
+        CheckBet(vBets[1], COutPoint(txUnknown.GetHash(), 0), CWalletBet::BET_PENDING);
+    }
+    vBets = pwalletMain->ListWalletBets(2, 2);
+    BOOST_CHECK_EQUAL(vBets.size(), 2U);
+    if (vBets.size() == 2U) {
+        CheckBet(vBets[0], COutPoint(txBets.GetHash(), 0), CWalletBet::BET_PENDING);
+        CheckBet(vBets[1], COutPoint(txBets.GetHash(), 1), CWalletBet::BET_PENDING);
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->ListWalletBets(2, 3).size(), 1U);
+    BOOST_CHECK(pwalletMain->ListWalletBets(10, 4).empty());
+    BOOST_CHECK(pwalletMain->ListWalletBets(0, 0).empty());
+
+    // A payout block for the draw of 2020-06-03, whose coinstake pays the winning bet
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vout.resize(1);
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txCoinStake.vout.resize(1);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout.emplace_back(10 * COIN, CScript() << OP_TRUE);
+    txCoinStake.vout.emplace_back(GetLottoBetPayout(CLottoBet(20200603, 7, 0, 0), COIN), scriptPayout);
+    BOOST_CHECK(CTransaction(txCoinStake).IsCoinStake());
+
+    CBlock block;
+    block.nTime = 1591300900;
+    block.vtx.push_back(txCoinBase);
+    block.vtx.push_back(txCoinStake);
+
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 60 * 1500 - 1;
+    indexPrev.nTime = 1591300800;
+    CBlockIndex index;
+    index.nHeight = 60 * 1500;
+    index.nTime = block.nTime;
+    index.pprev = &indexPrev;
+    BOOST_CHECK(IsBetPayoutHeight(index.nHeight, indexPrev.GetBlockTime()));
+    BOOST_CHECK_EQUAL(GetPaidDrawDate(indexPrev.GetBlockTime()), 20200603U);
+
+    const uint256 hashPrev = GetRandHash();
+    indexPrev.phashBlock = &mapBlockIndex.insert(std::make_pair(hashPrev, &indexPrev)).first->first;
+    index.phashBlock = &mapBlockIndex.insert(std::make_pair(block.GetHash(), &index)).first->first;
+
+    // Settlement: every bet up to the paid draw is settled by the coinstake
+    pwalletMain->SyncTransaction(block.vtx[1], &block);
+    vBets = pwalletMain->ListWalletBets(10, 0);
+    BOOST_CHECK_EQUAL(vBets.size(), 4U);
+    if (vBets.size() == 4U) {
+        CheckBet(vBets[0], COutPoint(txBets.GetHash(), 0), CWalletBet::BET_PAID);
+        BOOST_CHECK_EQUAL(vBets[0].nPayout, 12 * COIN);
+        BOOST_CHECK(vBets[0].txidPayout == block.vtx[1].GetHash());
+        BOOST_CHECK(vBets[0].hashSettleBlock == block.GetHash());
+        BOOST_CHECK_EQUAL(vBets[0].GetStatusString(), "paid");
+        CheckBet(vBets[1], COutPoint(txBets.GetHash(), 1), CWalletBet::BET_LOST);
+        BOOST_CHECK_EQUAL(vBets[1].GetStatusString(), "lost");
+        CheckBet(vBets[2], COutPoint(txBets.GetHash(), 2), CWalletBet::BET_PENDING);
+        BOOST_CHECK_EQUAL(vBets[2].GetStatusString(), "pending");
+        CheckBet(vBets[3], COutPoint(txUnknown.GetHash(), 0), CWalletBet::BET_UNKNOWN);
+        BOOST_CHECK(vBets[3].hashSettleBlock == block.GetHash());
+        BOOST_CHECK_EQUAL(vBets[3].GetStatusString(), "unknown");
+    }
+
+    // Disconnecting the payout block puts its settlements back to pending
+    pwalletMain->BlockDisconnected(block, &index);
+    for (const CWalletBet& bet : pwalletMain->ListWalletBets(10, 0)) {
+        BOOST_CHECK_EQUAL(bet.nStatus, CWalletBet::BET_PENDING);
+        BOOST_CHECK_EQUAL(bet.nPayout, 0);
+        BOOST_CHECK(bet.txidPayout.IsNull());
+        BOOST_CHECK(bet.hashSettleBlock.IsNull());
+    }
+
+    mapBlockIndex.erase(block.GetHash());
+    mapBlockIndex.erase(hashPrev);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,9 @@
 
 #include "wallet/wallet.h"
 
+#include "betting/bet.h"
+#include "blockfilter.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "guiinterfaceutil.h"
@@ -17,11 +20,13 @@
 #include "script/sign.h"
 #include "spork.h"
 #include "swifttx.h"    // mapTxLockReq
+#include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "zpwrbchain.h"
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 CWallet* pwalletMain = nullptr;
@@ -35,6 +40,8 @@ bool bSpendZeroConfChange = true;
 bool bdisableSystemnotifications = false; // Those bubbles can be annoying and slow down the UI when you get lots of trx
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
+int nStakeKernelThreads = 1;
+bool fCheckWalletBalances = false;
 
 /**
  * Fees smaller than this (in upwrb) are considered zero fee (for transaction creation)
@@ -580,6 +587,7 @@ bool CWallet::ParameterInteraction()
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", false);
     bdisableSystemnotifications = GetBoolArg("-disablesystemnotifications", false);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", false);
+    fCheckWalletBalances = GetBoolArg("-checkwalletbalances", Params().DefaultConsistencyChecks());
 
     return true;
 }
@@ -630,6 +638,11 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
     setLockedCoins.erase(outpoint);
+    MarkBalancesDirty();
+
+    std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(outpoint.hash);
+    if (mit != mapWallet.end() && outpoint.n < mit->second.vout.size())
+        setWalletUTXO.erase(std::make_pair(mit->second.vout[outpoint.n].nValue, outpoint));
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -648,6 +661,39 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToWalletUTXO(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (fWalletUTXODirty)
+        return;
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        const COutPoint outpoint(hash, i);
+        if (!mapTxSpends.count(outpoint) && IsMine(wtx.vout[i]) != ISMINE_NO)
+            setWalletUTXO.insert(std::make_pair(wtx.vout[i].nValue, outpoint));
+    }
+}
+
+void CWallet::RebuildWalletUTXO() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (!fWalletUTXODirty)
+        return;
+
+    setWalletUTXO.clear();
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        const CWalletTx& wtx = it->second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            if (IsMine(wtx.vout[i]) != ISMINE_NO && !IsSpent(it->first, i))
+                setWalletUTXO.insert(std::make_pair(wtx.vout[i].nValue, COutPoint(it->first, i)));
+        }
+    }
+    fWalletUTXODirty = false;
+    LogPrint(BCLog::SELECTCOINS, "%s: %u wallet outputs\n", __func__, setWalletUTXO.size());
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -827,6 +873,9 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
+        // The keys may have changed, re-evaluate which outputs are ours
+        fWalletUTXODirty = true;
+        MarkBalancesDirty();
     }
 }
 
@@ -897,6 +946,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        AddToWalletUTXO(wtx);
+        if (fInsertedNew)
+            AddWalletBets(wtx, pwalletdb);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1000,6 +1052,8 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
+            // The outputs it spent are available again
+            fWalletUTXODirty = true;
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1056,6 +1110,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             wtx.WriteToDisk(&walletdb);
+            fWalletUTXODirty = true;
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1078,9 +1133,20 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK(cs_wallet);
+    // The coinstake of a payout block settles our bets, whether it pays any of them or not
+    if (pblock && tx.IsCoinStake() && !mapWalletBets.empty()) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(pblock->GetHash());
+        if (mi != mapBlockIndex.end() && mi->second)
+            SettleWalletBets(tx, mi->second);
+    }
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
 
+    // A disconnected coinstake no longer spends its inputs
+    if (!pblock && tx.IsCoinStake())
+        fWalletUTXODirty = true;
+
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
     // recomputed, also:
@@ -1098,11 +1164,226 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        std::map<COutPoint, CWalletBet>::iterator it = mapWalletBets.lower_bound(COutPoint(hash, 0));
+        while (it != mapWalletBets.end() && it->first.hash == hash) {
+            setWalletBetsOrdered.erase(std::make_pair(it->second.nOrderPos, it->first));
+            CWalletDB(strWalletFile).EraseBet(it->first);
+            it = mapWalletBets.erase(it);
+        }
+        fWalletUTXODirty = true;
+        MarkBalancesDirty();
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
 }
 
+std::string CWalletBet::GetStatusString() const
+{
+    switch (nStatus) {
+    case BET_LOST:
+        return "lost";
+    case BET_PAID:
+        return "paid";
+    case BET_UNKNOWN:
+        return "unknown";
+    default:
+        return "pending";
+    }
+}
+
+void CWallet::LoadWalletBet(const CWalletBet& bet)
+{
+    std::map<COutPoint, CWalletBet>::iterator it = mapWalletBets.find(bet.outpoint);
+    if (it != mapWalletBets.end())
+        setWalletBetsOrdered.erase(std::make_pair(it->second.nOrderPos, bet.outpoint));
+    mapWalletBets[bet.outpoint] = bet;
+    setWalletBetsOrdered.insert(std::make_pair(bet.nOrderPos, bet.outpoint));
+}
+
+void CWallet::AddWalletBets(const CWalletTx& wtx, CWalletDB* pwalletdb)
+{
+    AssertLockHeld(cs_wallet);
+    if (wtx.IsCoinBase() || wtx.IsCoinStake())
+        return;
+
+    CScript scriptPayout;
+    bool fPayoutResolved = false;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        CLottoBet lb;
+        if (!CLottoBet::FromScript(wtx.vout[i].scriptPubKey, lb))
+            continue;
+        const COutPoint outpoint(wtx.GetHash(), i);
+        if (mapWalletBets.count(outpoint))
+            continue;
+
+        // Winning bets are paid to the address of the output spent by the first input, like GetBetPayouts does.
+        // If that output isn't ours the payout can't be recognized, and the bet is settled as unknown.
+        if (!fPayoutResolved) {
+            const CWalletTx* pprev = wtx.vin.empty() ? nullptr : GetWalletTx(wtx.vin[0].prevout.hash);
+            if (pprev && wtx.vin[0].prevout.n < pprev->vout.size()) {
+                CTxDestination payoutAddress;
+                ExtractDestination(pprev->vout[wtx.vin[0].prevout.n].scriptPubKey, payoutAddress);
+                scriptPayout = GetScriptForDestination(CBitcoinAddress(payoutAddress).Get());
+            }
+            fPayoutResolved = true;
+        }
+
+        CWalletBet bet;
+        bet.outpoint = outpoint;
+        bet.nOrderPos = wtx.nOrderPos;
+        bet.nDate = lb.nDate;
+        bet.nNumber1 = lb.nNumber1;
+        bet.nNumber2 = lb.nNumber2;
+        bet.nNumber3 = lb.nNumber3;
+        bet.nBetValue = wtx.vout[i].nValue;
+        bet.scriptPayout = scriptPayout;
+        LoadWalletBet(bet);
+
+        if (pwalletdb)
+            pwalletdb->WriteBet(bet);
+        else if (fFileBacked)
+            CWalletDB(strWalletFile).WriteBet(bet);
+    }
+}
+
+void CWallet::SettleWalletBets(const CTransaction& txCoinStake, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_wallet);
+    if (!pindex->pprev || !IsBetPayoutHeight(pindex->nHeight, pindex->pprev->GetBlockTime()))
+        return;
+
+    // Every bet on the paid draw, or an earlier one, is settled by this block: it is either
+    // paid by an output of the coinstake or it lost. Without a payout address we can't tell.
+    const uint32_t nPaidDate = GetPaidDrawDate(pindex->pprev->GetBlockTime());
+    std::vector<bool> vPaid(txCoinStake.vout.size(), false);
+    std::vector<const CWalletBet*> vSettled;
+    for (std::map<COutPoint, CWalletBet>::iterator it = mapWalletBets.begin(); it != mapWalletBets.end(); ++it) {
+        CWalletBet& bet = it->second;
+        if (bet.nStatus != CWalletBet::BET_PENDING || bet.nDate > nPaidDate)
+            continue;
+
+        bet.hashSettleBlock = pindex->GetBlockHash();
+        vSettled.push_back(&bet);
+        if (bet.scriptPayout.empty()) {
+            bet.nStatus = CWalletBet::BET_UNKNOWN;
+            continue;
+        }
+
+        const CAmount nPayout = GetLottoBetPayout(CLottoBet(bet.nDate, bet.nNumber1, bet.nNumber2, bet.nNumber3), bet.nBetValue);
+        bet.nStatus = CWalletBet::BET_LOST;
+        for (unsigned int i = 0; i < txCoinStake.vout.size(); i++) {
+            const CTxOut& txout = txCoinStake.vout[i];
+            if (!vPaid[i] && txout.nValue == nPayout && txout.scriptPubKey == bet.scriptPayout) {
+                vPaid[i] = true;
+                bet.nStatus = CWalletBet::BET_PAID;
+                bet.nPayout = nPayout;
+                bet.txidPayout = txCoinStake.GetHash();
+                break;
+            }
+        }
+    }
+
+    if (vSettled.empty())
+        return;
+    LogPrint(BCLog::BETTING, "%s : %d wallet bets settled by block %s (draw %d)\n", __func__, vSettled.size(), pindex->GetBlockHash().GetHex(), nPaidDate);
+    if (fFileBacked) {
+        CWalletDB walletdb(strWalletFile, "r+", false);
+        for (const CWalletBet* pbet : vSettled)
+            walletdb.WriteBet(*pbet);
+    }
+}
+
+void CWallet::BlockDisconnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    LOCK(cs_wallet);
+    const uint256& hashBlock = pindex->GetBlockHash();
+    for (std::map<COutPoint, CWalletBet>::iterator it = mapWalletBets.begin(); it != mapWalletBets.end(); ++it) {
+        CWalletBet& bet = it->second;
+        if (bet.nStatus == CWalletBet::BET_PENDING || bet.hashSettleBlock != hashBlock)
+            continue;
+        bet.SetPending();
+        if (fFileBacked)
+            CWalletDB(strWalletFile, "r+", false).WriteBet(bet);
+    }
+}
+
+void CWallet::ReindexWalletBets()
+{
+    if (!fFileBacked)
+        return;
+
+    LOCK2(cs_main, cs_wallet);
+    const int64_t nStart = GetTimeMicros();
+
+    CWalletDB walletdb(strWalletFile);
+    for (TxItems::const_iterator it = wtxOrdered.begin(); it != wtxOrdered.end(); ++it) {
+        if (it->second.first)
+            AddWalletBets(*it->second.first, &walletdb);
+    }
+
+    // Follow transaction reordering, and undo the settlements of blocks that were
+    // disconnected while the wallet wasn't loaded.
+    int nHeightStart = chainActive.Height() + 1;
+    for (std::map<COutPoint, CWalletBet>::iterator it = mapWalletBets.begin(); it != mapWalletBets.end(); ++it) {
+        CWalletBet& bet = it->second;
+        const CWalletTx* pwtx = GetWalletTx(bet.outpoint.hash);
+        bool fChanged = false;
+        if (pwtx && pwtx->nOrderPos != bet.nOrderPos) {
+            setWalletBetsOrdered.erase(std::make_pair(bet.nOrderPos, bet.outpoint));
+            bet.nOrderPos = pwtx->nOrderPos;
+            setWalletBetsOrdered.insert(std::make_pair(bet.nOrderPos, bet.outpoint));
+            fChanged = true;
+        }
+        if (bet.nStatus != CWalletBet::BET_PENDING) {
+            BlockMap::const_iterator mi = mapBlockIndex.find(bet.hashSettleBlock);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+                bet.SetPending();
+                fChanged = true;
+            }
+        }
+        if (fChanged)
+            walletdb.WriteBet(bet);
+
+        // Payout blocks after the bet was placed may settle it
+        if (bet.nStatus == CWalletBet::BET_PENDING && pwtx && !pwtx->hashUnset()) {
+            BlockMap::const_iterator mi = mapBlockIndex.find(pwtx->hashBlock);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+                nHeightStart = std::min(nHeightStart, mi->second->nHeight + 1);
+        }
+    }
+
+    // Replay the payout blocks, there is one at most every 1500 blocks
+    for (int nHeight = ((nHeightStart + 1499) / 1500) * 1500; nHeight <= chainActive.Height(); nHeight += 1500) {
+        CBlockIndex* pindex = chainActive[nHeight];
+        if (!IsBetPayoutHeight(nHeight, pindex->pprev->GetBlockTime()))
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            LogPrintf("%s : Failed to read payout block %s\n", __func__, pindex->GetBlockHash().GetHex());
+            continue;
+        }
+        if (block.vtx.size() > 1 && block.vtx[1].IsCoinStake())
+            SettleWalletBets(block.vtx[1], pindex);
+    }
+
+    LogPrint(BCLog::BENCH, "%s : %d wallet bets indexed in %.2fms\n", __func__, mapWalletBets.size(), (GetTimeMicros() - nStart) * 0.001);
+}
+
+std::vector<CWalletBet> CWallet::ListWalletBets(int nCount, int nFrom) const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<CWalletBet> vBets;
+    std::set<std::pair<int64_t, COutPoint> >::const_reverse_iterator it = setWalletBetsOrdered.rbegin();
+    for (; it != setWalletBetsOrdered.rend() && nFrom > 0; ++it)
+        nFrom--;
+    for (; it != setWalletBetsOrdered.rend() && (int)vBets.size() < nCount; ++it)
+        vBets.push_back(mapWalletBets.at(it->second));
+
+    // Newest to oldest so far
+    std::reverse(vBets.begin(), vBets.end());
+    return vBets;
+}
+
 isminetype CWallet::IsMine(const CTxIn& txin) const
 {
     {
@@ -1640,21 +1921,182 @@ bool CWallet::Upgrade(std::string& error, const int& prevVersion)
     return m_spk_man->Upgrade(prevVersion, error);
 }
 
+/** A block read ahead of the wallet rescan */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    //! Not read because its block filter matches none of our scripts
+    bool fSkipped;
+    //! For each transaction of the block, whether it pays one of our outputs
+    std::vector<bool> vIsMine;
+
+    explicit CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false), fSkipped(false) {}
+};
+
+/** Read every nThreads-th block of a rescan batch, starting at nThread, and match its outputs.
+ *  With a set of wallet scripts, the blocks whose filter matches none of them aren't read. */
+static void RescanReadBlocks(const CWallet* pwallet, std::vector<CRescanBlock>* pvBlocks, const GCSFilter::ElementSet* psetElements, unsigned int nThread, unsigned int nThreads)
+{
+    for (size_t i = nThread; i < pvBlocks->size(); i += nThreads) {
+        CRescanBlock& rescanBlock = (*pvBlocks)[i];
+        if (psetElements) {
+            BlockFilter filter;
+            if (pblockfilterdb->ReadFilter(rescanBlock.pindex->GetBlockHash(), filter) && !filter.GetFilter().MatchAny(*psetElements)) {
+                rescanBlock.fSkipped = true;
+                continue;
+            }
+        }
+
+        rescanBlock.fRead = ReadBlockFromDisk(rescanBlock.block, rescanBlock.pindex);
+        if (!rescanBlock.fRead)
+            continue;
+        // Only reads the keystore, which is safe while the committer holds cs_wallet
+        rescanBlock.vIsMine.resize(rescanBlock.block.vtx.size());
+        for (size_t j = 0; j < rescanBlock.block.vtx.size(); j++)
+            rescanBlock.vIsMine[j] = pwallet->IsMine(rescanBlock.block.vtx[j]);
+    }
+}
+
+/**
+ * A batch of consecutive active chain blocks, read and matched on background
+ * threads while the previous batch is committed to the wallet.
+ */
+class CRescanBatch
+{
+public:
+    std::vector<CRescanBlock> vBlocks;
+    //! Number of wallet keys when the outputs were matched
+    size_t nKeys;
+
+    CRescanBatch() : nKeys(0) {}
+    ~CRescanBatch() { Wait(); }
+
+    /** Start reading up to RESCAN_BATCH_BLOCKS blocks from pindexFirst on, skipping
+     *  the blocks that don't involve the wallet according to their filter if fUseFilters */
+    void Start(const CWallet* pwallet, CBlockIndex* pindexFirst, bool fUseFilters, unsigned int nThreads)
+    {
+        {
+            LOCK2(cs_main, pwallet->cs_wallet);
+            for (CBlockIndex* pindex = pindexFirst; pindex && vBlocks.size() < RESCAN_BATCH_BLOCKS; pindex = chainActive.Next(pindex))
+                vBlocks.push_back(CRescanBlock(pindex));
+            nKeys = pwallet->mapKeyMetadata.size();
+
+            fUseFilters &= pblockfilterdb != NULL && !vBlocks.empty();
+            if (fUseFilters) {
+                std::set<CScript> setScripts;
+                pwallet->GetScriptPubKeys(setScripts);
+                for (const CScript& script : setScripts)
+                    setElements.insert(GCSFilter::Element(script.begin(), script.end()));
+            }
+        }
+        nThreads = std::min(nThreads, (unsigned int)vBlocks.size());
+        for (unsigned int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&RescanReadBlocks, pwallet, &vBlocks, fUseFilters ? &setElements : NULL, i, nThreads));
+    }
+
+    void Wait() { threads.join_all(); }
+
+private:
+    boost::thread_group threads;
+    GCSFilter::ElementSet setElements;
+};
+
+/** The block following pindexLast on the active chain, or the one following the fork point if it was reorganized away */
+static CBlockIndex* RescanNextBlock(const CBlockIndex* pindexLast)
+{
+    AssertLockHeld(cs_main);
+    if (pindexLast && !chainActive.Contains(pindexLast))
+        pindexLast = chainActive.FindFork(pindexLast);
+    return pindexLast ? chainActive.Next(pindexLast) : chainActive.Genesis();
+}
+
+bool CWallet::IsRelatedToWallet(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (mapWallet.count(tx.GetHash()))
+        return true;
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::RescanZerocoinMints(const CBlock& block, const CBlockIndex* pindex, std::set<uint256>& setAddedToWallet)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::list<CZerocoinMint> listMints;
+    BlockToZerocoinMintList(block, listMints, true);
+    CWalletDB walletdb(strWalletFile);
+
+    for (auto& m : listMints) {
+        if (IsMyMint(m.GetValue())) {
+            LogPrint(BCLog::LEGACYZC, "%s: found mint\n", __func__);
+            UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
+
+            // Add the transaction to the wallet
+            for (auto& tx : block.vtx) {
+                uint256 txid = tx.GetHash();
+                if (setAddedToWallet.count(txid) || mapWallet.count(txid))
+                    continue;
+                if (txid == m.GetTxHash()) {
+                    CWalletTx wtx(this, tx);
+                    wtx.nTimeReceived = block.GetBlockTime();
+                    wtx.SetMerkleBranch(block);
+                    AddToWallet(wtx, false, &walletdb);
+                    setAddedToWallet.insert(txid);
+                }
+            }
+
+            //Check if the mint was ever spent
+            int nHeightSpend = 0;
+            uint256 txidSpend;
+            CTransaction txSpend;
+            if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
+                if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend))
+                    continue;
+
+                CWalletTx wtx(this, txSpend);
+                CBlockIndex* pindexSpend = chainActive[nHeightSpend];
+                CBlock blockSpend;
+                if (ReadBlockFromDisk(blockSpend, pindexSpend))
+                    wtx.SetMerkleBranch(blockSpend);
+
+                wtx.nTimeReceived = pindexSpend->nTime;
+                AddToWallet(wtx, false, &walletdb);
+                setAddedToWallet.emplace(txidSpend);
+            }
+        }
+    }
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and their outputs matched against our keys in batches,
+ * on background threads, one batch ahead of the blocks being added to the
+ * wallet. Batches are committed in chain order and cs_main and cs_wallet
+ * are released between them. With -blockfilterindex, the blocks whose
+ * filter matches none of our scripts aren't read at all.
  * @returns -1 if process was cancelled or the number of tx added to the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool fromStartup)
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nTimeStart = GetTimeMillis();
     bool fCheckZPWRB = GetBoolArg("-zapwallettxes", false);
     if (fCheckZPWRB)
         zpwrbTracker->Init();
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1664,79 +2106,94 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        std::set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            if (fromStartup && ShutdownRequested()) {
-                return -1;
-            }
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    // zPWRB mints aren't matched by the block filters
+    bool fUseFilters = !fCheckZPWRB;
+    unsigned int nThreads = std::max(1u, std::min(boost::thread::hardware_concurrency(), MAX_RESCAN_THREADS));
+    int nBlocks = 0;
+    int nSkipped = 0;
+    std::set<uint256> setAddedToWallet;
+    std::unique_ptr<CRescanBatch> batch(new CRescanBatch());
+    batch->Start(this, pindex, fUseFilters, nThreads);
+    while (!batch->vBlocks.empty()) {
+        batch->Wait();
+
+        // Read the next batch while this one is committed
+        CBlockIndex* pindexNext;
+        {
+            LOCK(cs_main);
+            pindexNext = RescanNextBlock(batch->vBlocks.back().pindex);
+        }
+        std::unique_ptr<CRescanBatch> nextBatch(new CRescanBatch());
+        nextBatch->Start(this, pindexNext, fUseFilters, nThreads);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            for (CTransaction& tx : block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
+        bool fRestart;
+        {
+            LOCK2(cs_main, cs_wallet);
 
-            //If this is a zapwallettx, need to readd zpwrb
-            if (fCheckZPWRB && pindex->nHeight >= Params().GetConsensus().height_start_ZC) {
-                std::list<CZerocoinMint> listMints;
-                BlockToZerocoinMintList(block, listMints, true);
-                CWalletDB walletdb(strWalletFile);
-
-                for (auto& m : listMints) {
-                    if (IsMyMint(m.GetValue())) {
-                        LogPrint(BCLog::LEGACYZC, "%s: found mint\n", __func__);
-                        UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
-
-                        // Add the transaction to the wallet
-                        for (auto& tx : block.vtx) {
-                            uint256 txid = tx.GetHash();
-                            if (setAddedToWallet.count(txid) || mapWallet.count(txid))
-                                continue;
-                            if (txid == m.GetTxHash()) {
-                                CWalletTx wtx(this, tx);
-                                wtx.nTimeReceived = block.GetBlockTime();
-                                wtx.SetMerkleBranch(block);
-                                AddToWallet(wtx, false, &walletdb);
-                                setAddedToWallet.insert(txid);
-                            }
-                        }
+            CBlockIndex* pindexLast = batch->vBlocks.front().pindex->pprev;
+            for (CRescanBlock& rescanBlock : batch->vBlocks) {
+                pindex = rescanBlock.pindex;
+                // Reorganized away while being read, resume from the fork point
+                if (!chainActive.Contains(pindex))
+                    break;
 
-                        //Check if the mint was ever spent
-                        int nHeightSpend = 0;
-                        uint256 txidSpend;
-                        CTransaction txSpend;
-                        if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
-                            if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend))
-                                continue;
-
-                            CWalletTx wtx(this, txSpend);
-                            CBlockIndex* pindexSpend = chainActive[nHeightSpend];
-                            CBlock blockSpend;
-                            if (ReadBlockFromDisk(blockSpend, pindexSpend))
-                                wtx.SetMerkleBranch(blockSpend);
-
-                            wtx.nTimeReceived = pindexSpend->nTime;
-                            AddToWallet(wtx, false, &walletdb);
-                            setAddedToWallet.emplace(txidSpend);
-                        }
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                if (fromStartup && ShutdownRequested()) {
+                    return -1;
+                }
+
+                // The readers didn't match the outputs against keys added since: keypool top ups,
+                // also by the transactions added from the previous blocks of this batch
+                if (rescanBlock.fSkipped && mapKeyMetadata.size() != batch->nKeys) {
+                    // The filter was only matched against the keys we had back then
+                    rescanBlock.fRead = ReadBlockFromDisk(rescanBlock.block, pindex);
+                    rescanBlock.vIsMine.assign(rescanBlock.block.vtx.size(), true);
+                } else if (rescanBlock.fSkipped) {
+                    nSkipped++;
+                }
+
+                if (rescanBlock.fRead) {
+                    const CBlock& block = rescanBlock.block;
+                    for (size_t i = 0; i < block.vtx.size(); i++) {
+                        const CTransaction& tx = block.vtx[i];
+                        const bool fKeysChanged = mapKeyMetadata.size() != batch->nKeys;
+                        if ((fKeysChanged || rescanBlock.vIsMine[i] || IsRelatedToWallet(tx)) && AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                            ret++;
                     }
+
+                    //If this is a zapwallettx, need to readd zpwrb
+                    if (fCheckZPWRB && pindex->nHeight >= Params().GetConsensus().height_start_ZC)
+                        RescanZerocoinMints(block, pindex, setAddedToWallet);
                 }
-            }
+                pindexLast = pindex;
+                nBlocks++;
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                }
             }
+
+            // The chain changed since the next batch was started
+            CBlockIndex* pindexResume = RescanNextBlock(pindexLast);
+            fRestart = pindexResume != pindexNext;
+            pindexNext = pindexResume;
+        }
+
+        if (fRestart) {
+            nextBatch.reset(new CRescanBatch());
+            nextBatch->Start(this, pindexNext, fUseFilters, nThreads);
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        batch = std::move(nextBatch);
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    LogPrintf("%s : rescanned %d blocks (%d skipped by their filter) in %dms (%u reader threads)\n", __func__, nBlocks, nSkipped, GetTimeMillis() - nTimeStart, nThreads);
     return ret;
 }
 
@@ -1855,136 +2312,168 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)> method) const
+bool CWalletBalances::operator==(const CWalletBalances& b) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& it : mapWallet) {
-            method(it.first, it.second, nTotal);
+    return nTrusted == b.nTrusted && nTrustedDelegated == b.nTrustedDelegated &&
+           nColdStaking == b.nColdStaking && nDelegated == b.nDelegated &&
+           nStaking == b.nStaking && nStakingCold == b.nStakingCold &&
+           nUnlocked == b.nUnlocked && nLocked == b.nLocked && nUnconfirmed == b.nUnconfirmed &&
+           nImmature == b.nImmature && nImmatureColdStaking == b.nImmatureColdStaking &&
+           nImmatureDelegated == b.nImmatureDelegated && nWatchOnly == b.nWatchOnly &&
+           nUnconfirmedWatchOnly == b.nUnconfirmedWatchOnly && nImmatureWatchOnly == b.nImmatureWatchOnly &&
+           nLockedWatchOnly == b.nLockedWatchOnly;
+}
+
+std::string CWalletBalances::ToString() const
+{
+    return strprintf("CWalletBalances(trusted=%s (delegated %s), cold=%s, delegated=%s, staking=%s (cold %s), "
+                     "unlocked=%s, locked=%s, unconfirmed=%s, immature=%s (cold %s, delegated %s), "
+                     "watchonly=%s, unconfirmed watchonly=%s, immature watchonly=%s, locked watchonly=%s)",
+                     FormatMoney(nTrusted), FormatMoney(nTrustedDelegated), FormatMoney(nColdStaking), FormatMoney(nDelegated),
+                     FormatMoney(nStaking), FormatMoney(nStakingCold), FormatMoney(nUnlocked), FormatMoney(nLocked),
+                     FormatMoney(nUnconfirmed), FormatMoney(nImmature), FormatMoney(nImmatureColdStaking),
+                     FormatMoney(nImmatureDelegated), FormatMoney(nWatchOnly), FormatMoney(nUnconfirmedWatchOnly),
+                     FormatMoney(nImmatureWatchOnly), FormatMoney(nLockedWatchOnly));
+}
+
+CWalletBalances CWallet::ComputeBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletBalances balances;
+    for (const auto& it : mapWallet) {
+        const CWalletTx& pcoin = it.second;
+        // Depth and trust are the same for every category, only look them up once
+        const bool fTrusted = pcoin.IsTrusted();
+        const int nDepth = pcoin.GetDepthInMainChain();
+
+        if (fTrusted) {
+            const CAmount nAvailable = pcoin.GetAvailableCredit();
+            const CAmount nDelegation = pcoin.GetStakeDelegationCredit();
+            balances.nTrusted += nAvailable;
+            balances.nTrustedDelegated += nDelegation;
+            balances.nWatchOnly += pcoin.GetAvailableWatchOnlyCredit();
+            if (pcoin.HasP2CSOutputs()) {
+                balances.nColdStaking += pcoin.GetColdStakingCredit();
+                balances.nDelegated += nDelegation;
+            }
+            if (nDepth >= Params().GetConsensus().nStakeMinDepth) {
+                balances.nStaking += nAvailable - nDelegation - pcoin.GetLockedCredit();
+                balances.nStakingCold += pcoin.GetColdStakingCredit();
+            }
+            if (nDepth > 0) {
+                balances.nUnlocked += pcoin.GetUnlockedCredit();
+                balances.nLocked += pcoin.GetLockedCredit();
+                balances.nLockedWatchOnly += pcoin.GetLockedWatchOnlyCredit();
+            }
+        } else if (nDepth == 0 && pcoin.InMempool()) {
+            balances.nUnconfirmed += pcoin.GetAvailableCredit();
+            balances.nUnconfirmedWatchOnly += pcoin.GetAvailableWatchOnlyCredit();
         }
+
+        balances.nImmature += pcoin.GetImmatureCredit(false);
+        balances.nImmatureColdStaking += pcoin.GetImmatureCredit(false, ISMINE_COLD);
+        balances.nImmatureDelegated += pcoin.GetImmatureCredit(false, ISMINE_SPENDABLE_DELEGATED);
+        balances.nImmatureWatchOnly += pcoin.GetImmatureWatchOnlyCredit();
     }
-    return nTotal;
+    return balances;
 }
 
-CAmount CWallet::GetBalance(bool fIncludeDelegated) const
+CWalletBalances CWallet::GetBalances() const
 {
-    return loopTxsBalance([fIncludeDelegated](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal){
-        if (pcoin.IsTrusted()) {
-            nTotal += pcoin.GetAvailableCredit();
-            if (!fIncludeDelegated) nTotal -= pcoin.GetStakeDelegationCredit();
+    LOCK2(cs_main, cs_wallet);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (fBalancesDirty || pindexTip != pindexBalancesTip || nCompleteTXLocks != nBalancesTXLocks) {
+        fBalancesDirty = false;
+        cachedBalances = ComputeBalances();
+        pindexBalancesTip = pindexTip;
+        nBalancesTXLocks = nCompleteTXLocks;
+    } else if (fCheckWalletBalances) {
+        const CWalletBalances balances = ComputeBalances();
+        if (!(balances == cachedBalances)) {
+            LogPrintf("%s: cached %s\n", __func__, cachedBalances.ToString());
+            LogPrintf("%s: computed %s\n", __func__, balances.ToString());
+            assert(!"cached wallet balances out of date");
         }
-    });
+    }
+    return cachedBalances;
+}
+
+CAmount CWallet::GetBalance(bool fIncludeDelegated) const
+{
+    const CWalletBalances balances = GetBalances();
+    return fIncludeDelegated ? balances.nTrusted : balances.nTrusted - balances.nTrustedDelegated;
 }
 
 CAmount CWallet::GetColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-        if (pcoin.HasP2CSOutputs() && pcoin.IsTrusted())
-            nTotal += pcoin.GetColdStakingCredit();
-    });
+    return GetBalances().nColdStaking;
 }
 
 CAmount CWallet::GetStakingBalance(const bool fIncludeColdStaking) const
 {
-    return std::max(CAmount(0), loopTxsBalance(
-            [fIncludeColdStaking](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-        if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= Params().GetConsensus().nStakeMinDepth) {
-            nTotal += pcoin.GetAvailableCredit();       // available coins
-            nTotal -= pcoin.GetStakeDelegationCredit(); // minus delegated coins, if any
-            nTotal -= pcoin.GetLockedCredit();          // minus locked coins, if any
-            if (fIncludeColdStaking)
-                nTotal += pcoin.GetColdStakingCredit(); // plus cold coins, if any and if requested
-        }
-    }));
+    const CWalletBalances balances = GetBalances();
+    return std::max(CAmount(0), balances.nStaking + (fIncludeColdStaking ? balances.nStakingCold : 0));
 }
 
 CAmount CWallet::GetDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.HasP2CSOutputs() && pcoin.IsTrusted())
-                nTotal += pcoin.GetStakeDelegationCredit();
-    });
+    return GetBalances().nDelegated;
 }
 
 CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() > 0)
-                nTotal += pcoin.GetUnlockedCredit();
-    });
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() > 0)
-                nTotal += pcoin.GetLockedCredit();
-    });
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableCredit();
-    });
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false);
-    });
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetImmatureColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false, ISMINE_COLD);
-    });
+    return GetBalances().nImmatureColdStaking;
 }
 
 CAmount CWallet::GetImmatureDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false, ISMINE_SPENDABLE_DELEGATED);
-    });
+    return GetBalances().nImmatureDelegated;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureWatchOnlyCredit();
-    });
+    return GetBalances().nImmatureWatchOnly;
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() > 0)
-                nTotal += pcoin.GetLockedWatchOnlyCredit();
-    });
+    return GetBalances().nLockedWatchOnly;
 }
 
 void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
@@ -2023,7 +2512,7 @@ void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
 }
 
 /**
- * populate vCoins with vector of available COutputs.
+ * populate vCoins with vector of available COutputs, largest value first.
  */
 bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates when != nullptr
                              const CCoinControl* coinControl,   // Default: nullptr
@@ -2044,10 +2533,26 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
+        RebuildWalletUTXO();
+        for (std::set<std::pair<CAmount, COutPoint> >::const_reverse_iterator uit = setWalletUTXO.rbegin(); uit != setWalletUTXO.rend(); ++uit) {
+            const uint256& wtxid = uit->second.hash;
+            const unsigned int i = uit->second.n;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end()) continue;
             const CWalletTx* pcoin = &(*it).second;
 
+            // Output checks first, they are cheaper than the transaction ones
+            bool found = false;
+            if (nCoinType == ONLY_10000) {
+                found = pcoin->vout[i].nValue == 10 * COIN;
+            } else {
+                found = true;
+            }
+            if (!found) continue;
+
+            if (nCoinType == STAKEABLE_COINS && pcoin->vout[i].IsZerocoinMint()) continue;
+            if (IsSpent(wtxid, i)) continue;
+
             if (!CheckFinalTx(*pcoin)) continue;
             if (fOnlyConfirmed && !pcoin->IsTrusted()) continue;
             if (pcoin->GetBlocksToMaturity() > 0) continue;
@@ -2064,44 +2569,31 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
             if (nCoinType == STAKEABLE_COINS && nDepth <= Params().GetConsensus().nStakeMinDepth && chainActive.Height() > Params().GetConsensus().height_start_TimeProtoV2) continue;
             if (nCoinType == STAKEABLE_COINS && nDepth <= Params().GetConsensus().nCoinbaseMaturity && chainActive.Height() <= Params().GetConsensus().height_start_TimeProtoV2) continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_10000) {
-                    found = pcoin->vout[i].nValue == 10 * COIN;
-                } else {
-                    found = true;
-                }
-                if (!found) continue;
-
-                if (nCoinType == STAKEABLE_COINS && pcoin->vout[i].IsZerocoinMint()) continue;
-                if (IsSpent(wtxid, i)) continue;
-
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (  (mine == ISMINE_NO) ||
-                      ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2) ||
-                      (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1) ||
-                      (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000) ||
-                      (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue) ||
-                      (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                   ) continue;
-
-                // --Skip P2CS outputs
-                // skip cold coins
-                if (mine == ISMINE_COLD && (!fIncludeColdStaking || !HasDelegator(pcoin->vout[i]))) continue;
-                // skip delegated coins
-                if (mine == ISMINE_SPENDABLE_DELEGATED && !fIncludeDelegated) continue;
-                // skip auto-delegated coins
-                if (mine == ISMINE_SPENDABLE_STAKEABLE && !fIncludeColdStaking && !fIncludeDelegated) continue;
-
-                bool fIsValid = (
-                        ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                        ((mine & (ISMINE_MULTISIG | (fIncludeColdStaking ? ISMINE_COLD : ISMINE_NO) |
-                                (fIncludeDelegated ? ISMINE_SPENDABLE_DELEGATED : ISMINE_NO) )) != ISMINE_NO));
-
-                // found valid coin
-                if (!pCoins) return true;
-                pCoins->emplace_back(COutput(pcoin, i, nDepth, fIsValid));
-            }
+            isminetype mine = IsMine(pcoin->vout[i]);
+            if (  (mine == ISMINE_NO) ||
+                  ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2) ||
+                  (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1) ||
+                  (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000) ||
+                  (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue) ||
+                  (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+               ) continue;
+
+            // --Skip P2CS outputs
+            // skip cold coins
+            if (mine == ISMINE_COLD && (!fIncludeColdStaking || !HasDelegator(pcoin->vout[i]))) continue;
+            // skip delegated coins
+            if (mine == ISMINE_SPENDABLE_DELEGATED && !fIncludeDelegated) continue;
+            // skip auto-delegated coins
+            if (mine == ISMINE_SPENDABLE_STAKEABLE && !fIncludeColdStaking && !fIncludeDelegated) continue;
+
+            bool fIsValid = (
+                    ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                    ((mine & (ISMINE_MULTISIG | (fIncludeColdStaking ? ISMINE_COLD : ISMINE_NO) |
+                            (fIncludeDelegated ? ISMINE_SPENDABLE_DELEGATED : ISMINE_NO) )) != ISMINE_NO));
+
+            // found valid coin
+            if (!pCoins) return true;
+            pCoins->emplace_back(COutput(pcoin, i, nDepth, fIsValid));
         }
         return (pCoins && pCoins->size() > 0);
     }
@@ -2178,6 +2670,74 @@ static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const
     }
 }
 
+/**
+ * Depth first search for the subset of vValue (sorted by descending value) with the smallest
+ * total in [nTargetValue, nTargetValue + nCostOfChange), i.e. a selection that needs no change
+ * output. Gives up after BNB_TOTAL_TRIES subsets.
+ */
+static bool SelectCoinsBnB(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::vector<char>& vfBest, CAmount& nBest)
+{
+    CAmount nTotal = 0;
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        nTotal += vValue[i].first;
+    if (nTotal < nTargetValue)
+        return false;
+
+    // vfSelection holds the inclusion decisions for the first vfSelection.size() coins
+    std::vector<char> vfSelection;
+    CAmount nValue = 0;
+    CAmount nRemaining = nTotal;
+    nBest = std::numeric_limits<CAmount>::max();
+    vfBest.clear();
+
+    for (int nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nValue + nRemaining < nTargetValue || nValue >= nTargetValue + nCostOfChange) {
+            // Can't reach the target anymore, or already over the change-less window
+            fBacktrack = true;
+        } else if (nValue >= nTargetValue) {
+            if (nValue < nBest) {
+                nBest = nValue;
+                vfBest = vfSelection;
+                vfBest.resize(vValue.size(), false);
+                if (nBest == nTargetValue)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included coin and try the branch without it
+            while (!vfSelection.empty() && !vfSelection.back()) {
+                vfSelection.pop_back();
+                nRemaining += vValue[vfSelection.size()].first;
+            }
+            if (vfSelection.empty())
+                break; // Explored the whole tree
+            vfSelection.back() = false;
+            nValue -= vValue[vfSelection.size() - 1].first;
+        } else {
+            const unsigned int i = vfSelection.size();
+            nRemaining -= vValue[i].first;
+            if (!vfSelection.empty() && !vfSelection.back() && vValue[i].first == vValue[i - 1].first) {
+                // Including this coin would give the same subsets as the excluded one of equal value
+                vfSelection.push_back(false);
+            } else {
+                vfSelection.push_back(true);
+                nValue += vValue[i].first;
+            }
+        }
+    }
+
+    return !vfBest.empty();
+}
+
+/** Smallest change amount that isn't dust: a lower one is added to the fee by CreateTransaction. */
+static CAmount GetMinChangeValue()
+{
+    const CTxOut txoutChange(0, GetScriptForDestination(CKeyID()));
+    return 3 * ::minRelayTxFee.GetFee(::GetSerializeSize(txoutChange, SER_DISK, 0) + 148u);
+}
 
 bool CWallet::StakeableCoins(std::vector<COutput>* pCoins)
 {
@@ -2191,7 +2751,7 @@ bool CWallet::StakeableCoins(std::vector<COutput>* pCoins)
             STAKEABLE_COINS);  // coin type
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2203,7 +2763,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    // Ties between coins of equal value are broken at random, without shuffling all of vCoins:
+    // nExactMatches and nLowestLarger count the candidates seen so far for each pick.
+    FastRandomContext insecure_rand;
+    std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > coinExactMatch;
+    unsigned int nExactMatches = 0;
+    unsigned int nLowestLarger = 0;
 
     for (const COutput& output : vCoins) {
         if (!output.fSpendable)
@@ -2220,17 +2785,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > coin = std::make_pair(n, std::make_pair(pcoin, i));
 
         if (n == nTargetValue) {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
-            return true;
+            if (insecure_rand.randrange(++nExactMatches) == 0)
+                coinExactMatch = coin;
         } else if (n < nTargetValue + CENT) {
             vValue.push_back(coin);
             nTotalLower += n;
         } else if (n < coinLowestLarger.first) {
             coinLowestLarger = coin;
+            nLowestLarger = 1;
+        } else if (n == coinLowestLarger.first && insecure_rand.randrange(++nLowestLarger) == 0) {
+            coinLowestLarger = coin;
         }
     }
 
+    if (nExactMatches > 0) {
+        setCoinsRet.insert(coinExactMatch.second);
+        nValueRet += coinExactMatch.first;
+        return true;
+    }
+
     if (nTotalLower == nTargetValue) {
         for (unsigned int i = 0; i < vValue.size(); ++i) {
             setCoinsRet.insert(vValue[i].second);
@@ -2247,11 +2820,35 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    // AvailableCoins returns the coins largest first, only sort if they come from elsewhere
+    if (!std::is_sorted(vValue.rbegin(), vValue.rend(), CompareValueOnly()))
+        std::sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    // Shuffle each run of equal values, so that the solvers don't always pick the same coins
+    for (unsigned int i = 0; i < vValue.size();) {
+        unsigned int j = i + 1;
+        while (j < vValue.size() && vValue[j].first == vValue[i].first)
+            j++;
+        for (unsigned int k = j - 1; k > i; k--)
+            std::swap(vValue[k], vValue[i + insecure_rand.randrange(k - i + 1)]);
+        i = j;
+    }
+
     std::vector<char> vfBest;
     CAmount nBest;
 
+    // Look for an exact match first: a selection whose change would be dust needs no change output
+    if (SelectCoinsBnB(vValue, nTargetValue, GetMinChangeValue(), vfBest, nBest)) {
+        for (unsigned int i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+            }
+        }
+        LogPrint(BCLog::SELECTCOINS, "%s: branch and bound selected %u coins - total %s\n", __func__, setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
@@ -2280,6 +2877,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
 bool CWallet::SelectCoinsToSpend(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX, bool fIncludeColdStaking, bool fIncludeDelegated) const
 {
     // Note: this function should never be used for "always free" tx types like dstx
+    int64_t nTimeStart = GetTimeMicros();
     std::vector<COutput> vCoins;
     AvailableCoins(&vCoins,
             coinControl,
@@ -2302,9 +2900,14 @@ bool CWallet::SelectCoinsToSpend(const CAmount& nTargetValue, std::set<std::pair
         return (nValueRet >= nTargetValue);
     }
 
-    return (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
+    int64_t nTime1 = GetTimeMicros();
+    bool fSelected = (SelectCoinsMinConf(nTargetValue, 1, 6, vCoins, setCoinsRet, nValueRet) ||
+                      SelectCoinsMinConf(nTargetValue, 1, 1, vCoins, setCoinsRet, nValueRet) ||
+                      (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "%s: %u available coins: %.2fms, selected %u coins: %.2fms\n", __func__,
+             vCoins.size(), 0.001 * (nTime1 - nTimeStart), setCoinsRet.size(), 0.001 * (nTime2 - nTime1));
+    return fSelected;
 }
 
 bool CWallet::GetBudgetSystemCollateralTX(CWalletTx& tx, uint256 hash, bool useIX)
@@ -2594,6 +3197,75 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, strFailReason, coinControl, coin_type, useIX, nFeePay, fIncludeDelegated, opReturn);
 }
 
+void CWallet::UpdateStakeCandidates(const std::vector<COutput>& vCoins)
+{
+    AssertLockHeld(cs_stakeCandidates);
+    LOCK2(cs_main, cs_wallet);
+
+    std::map<COutPoint, CStakeCandidate> mapCandidates;
+    for (const COutput& out : vCoins) {
+        const COutPoint outpoint(out.tx->GetHash(), out.i);
+
+        // Keep the candidates that are still confirmed in the active chain
+        std::map<COutPoint, CStakeCandidate>::iterator it = mapStakeCandidates.find(outpoint);
+        if (it != mapStakeCandidates.end()) {
+            CBlockIndex* pindexFrom = it->second.stake.GetIndexFrom();
+            if (pindexFrom && chainActive.Contains(pindexFrom)) {
+                mapCandidates.emplace(outpoint, std::move(it->second));
+                continue;
+            }
+        }
+
+        // New utxo (or reorganized): the wallet already knows its block
+        CBlockIndex* pindexFrom = nullptr;
+        BlockMap::iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+            pindexFrom = mi->second;
+        mapCandidates[outpoint].stake.SetPrevout((CTransaction) *out.tx, out.i, pindexFrom);
+    }
+    mapStakeCandidates.swap(mapCandidates);
+}
+
+static CCheckQueue<CStakeKernelCheck> stakekernelqueue(128);
+
+void ThreadStakeKernelCheck()
+{
+    util::ThreadRename("pwrb-stakekrnl");
+    stakekernelqueue.Thread();
+}
+
+bool CStakeKernelCheck::operator()()
+{
+    //new block came in, stop scanning
+    if (chainActive.Height() != pindexPrev->nHeight) return false;
+
+    pcandidate->fScanFound = Stake(pindexPrev, &pcandidate->stake, nBits, pcandidate->nScanTime, pcandidate->kernel);
+    pcandidate->fScanned = true;
+    return !pcandidate->fScanFound;
+}
+
+/*
+ * Hash the kernels of all the candidates on the kernel scanning threads. The scan stops as soon
+ * as a kernel is found, so the candidates left unscanned are checked by CreateCoinStake, which
+ * walks the results in order and picks the same kernel a serial scan would.
+ */
+void CWallet::ScanStakeKernels(const CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTimeTx)
+{
+    AssertLockHeld(cs_stakeCandidates);
+
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(mapStakeCandidates.size());
+    for (auto& it : mapStakeCandidates) {
+        if (it.second.stake.IsZPWRB()) continue;
+        it.second.nScanTime = nTimeTx;
+        vChecks.emplace_back(pindexPrev, nBits, &it.second);
+    }
+
+    CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool CWallet::CreateCoinStake(
         const CKeyStore& keystore,
         const CBlockIndex* pindexPrev,
@@ -2602,6 +3274,8 @@ bool CWallet::CreateCoinStake(
         int64_t& nTxNewTime
         )
 {
+    LOCK(cs_stakeCandidates);
+
     // Get the list of stakable utxos
     std::vector<COutput> vCoins;
     if (!StakeableCoins(&vCoins)) {
@@ -2609,13 +3283,8 @@ bool CWallet::CreateCoinStake(
         return false;
     }
 
-    // Parse utxos into CPwrbStakes
-    std::list<std::unique_ptr<CStakeInput> > listInputs;
-    for (const COutput &out : vCoins) {
-        std::unique_ptr<CPwrbStake> input(new CPwrbStake());
-        input->SetPrevout((CTransaction) *out.tx, out.i);
-        listInputs.emplace_back(std::move(input));
-    }
+    // Sync the CPwrbStakes with the utxos
+    UpdateStakeCandidates(vCoins);
 
     const Consensus::Params& consensus = Params().GetConsensus();
 
@@ -2626,14 +3295,33 @@ bool CWallet::CreateCoinStake(
 
     // update staker status (hash)
     pStakerStatus->SetLastTip(pindexPrev);
-    pStakerStatus->SetLastCoins(listInputs.size());
+    pStakerStatus->SetLastCoins(mapStakeCandidates.size());
+
+    // The kernel of a previous attempt is only reused on top of the same block
+    for (auto& it : mapStakeCandidates) {
+        CStakeCandidate& candidate = it.second;
+        if (candidate.pindexKernelPrev != pindexPrev || candidate.nKernelBits != nBits) {
+            candidate.kernel.reset();
+            candidate.pindexKernelPrev = pindexPrev;
+            candidate.nKernelBits = nBits;
+        }
+        candidate.fScanned = false;
+        candidate.fScanFound = false;
+    }
 
     // Kernel Search
+    const int64_t nTimeStart = GetTimeMicros();
+    if (nStakeKernelThreads > 1 && !IsLocked())
+        ScanStakeKernels(pindexPrev, nBits, nTxNewTime);
+
     CAmount nCredit;
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
     int nAttempts = 0;
-    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
+    for (auto& it : mapStakeCandidates) {
+        CStakeCandidate& candidate = it.second;
+        CStakeInput* stakeInput = &candidate.stake;
+
         //new block came in, move on
         if (chainActive.Height() != pindexPrev->nHeight) return false;
 
@@ -2649,7 +3337,12 @@ bool CWallet::CreateCoinStake(
         nCredit = 0;
 
         nAttempts++;
-        fKernelFound = Stake(pindexPrev, stakeInput.get(), nBits, nTxNewTime);
+        if (candidate.fScanned) {
+            fKernelFound = candidate.fScanFound;
+            nTxNewTime = candidate.nScanTime;
+        } else {
+            fKernelFound = Stake(pindexPrev, stakeInput, nBits, nTxNewTime, candidate.kernel);
+        }
 
         // update staker status (time, attempts)
         pStakerStatus->SetLastTime(nTxNewTime);
@@ -2710,7 +3403,9 @@ bool CWallet::CreateCoinStake(
 
         break;
     }
-    LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
+    const int64_t nTimeElapsed = GetTimeMicros() - nTimeStart;
+    LogPrint(BCLog::STAKING, "%s: attempted staking %d times in %.2fms (%.0f kernels/s, %d threads)\n", __func__, nAttempts,
+             nTimeElapsed * 0.001, nTimeElapsed > 0 ? nAttempts * 1000000.0 / nTimeElapsed : 0.0, std::max(nStakeKernelThreads, 1));
 
     if (!fKernelFound)
         return false;
@@ -3204,18 +3899,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkBalancesDirty();
 }
 
 bool CWallet::IsLockedCoin(const uint256& hash, unsigned int n) const
@@ -3760,6 +4458,10 @@ void CWallet::SetNull()
     nLastResend = 0;
     nTimeFirstKey = 0;
     fWalletUnlockStaking = false;
+    fWalletUTXODirty = true;
+    fBalancesDirty = true;
+    pindexBalancesTip = nullptr;
+    nBalancesTXLocks = 0;
 
     // Staker status (last hashed block and time)
     if (pStakerStatus) {
@@ -3840,6 +4542,24 @@ bool CWallet::IsMine(const CTransaction& tx) const
     return false;
 }
 
+void CWallet::GetScriptPubKeys(std::set<CScript>& setScripts) const
+{
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    for (const CKeyID& keyID : setKeys) {
+        setScripts.insert(GetScriptForDestination(keyID));
+        CPubKey pubkey;
+        if (GetPubKey(keyID, pubkey))
+            setScripts.insert(GetScriptForRawPubKey(pubkey));
+    }
+
+    LOCK(cs_KeyStore);
+    for (const auto& it : mapScripts)
+        setScripts.insert(GetScriptForDestination(it.first));
+    setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+}
+
 bool CWallet::IsFromMe(const CTransaction& tx) const
 {
     return (GetDebit(tx, ISMINE_ALL) > 0);
@@ -4032,6 +4752,8 @@ void CWalletTx::MarkDirty()
     fColdCreditCached = false;
     fDelegatedDebitCached = false;
     fDelegatedCreditCached = false;
+    if (pwallet)
+        pwallet->MarkBalancesDirty();
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -35,6 +35,7 @@
 #include "zpwrb/zpwrbtracker.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -55,6 +56,8 @@ extern bool bSpendZeroConfChange;
 extern bool bdisableSystemnotifications;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
+extern int nStakeKernelThreads;
+extern bool fCheckWalletBalances;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -68,6 +71,16 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! Maximum number of stake kernel scanning threads allowed
+static const int MAX_STAKEKERNEL_THREADS = 16;
+//! -stakingthreads default (number of stake kernel scanning threads, 0 = auto)
+static const int DEFAULT_STAKEKERNEL_THREADS = 1;
+//! Maximum number of threads reading blocks ahead of a wallet rescan
+static const unsigned int MAX_RESCAN_THREADS = 8;
+//! Number of blocks a wallet rescan reads ahead and commits at once
+static const unsigned int RESCAN_BATCH_BLOCKS = 64;
+//! Number of subsets the branch and bound coin selection explores before giving up
+static const int BNB_TOTAL_TRIES = 100000;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -217,6 +230,153 @@ public:
     bool IsActive() const { return (nTime + 30) >= GetTime(); }
 };
 
+/** Stakeable utxo kept between stake attempts:
+ *  - stake          input, with the index of the block the utxo was confirmed in
+ *  - kernel         kernel on top of pindexKernelPrev with target nKernelBits, reused for every time slot
+**/
+struct CStakeCandidate
+{
+    CPwrbStake stake;
+    const CBlockIndex* pindexKernelPrev{nullptr};
+    unsigned int nKernelBits{0};
+    std::unique_ptr<CStakeKernel> kernel;
+    // outcome of the parallel kernel scan of the current attempt
+    bool fScanned{false};
+    bool fScanFound{false};
+    int64_t nScanTime{0};
+};
+
+/** Stake() of one candidate on the kernel scanning threads. Fails when a kernel is found
+ *  or a new block came in, so that the other threads stop scanning. */
+class CStakeKernelCheck
+{
+private:
+    const CBlockIndex* pindexPrev{nullptr};
+    unsigned int nBits{0};
+    CStakeCandidate* pcandidate{nullptr};
+
+public:
+    CStakeKernelCheck() {}
+    CStakeKernelCheck(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn, CStakeCandidate* pcandidateIn) :
+            pindexPrev(pindexPrevIn), nBits(nBitsIn), pcandidate(pcandidateIn) {}
+
+    bool operator()();
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(pindexPrev, check.pindexPrev);
+        std::swap(nBits, check.nBits);
+        std::swap(pcandidate, check.pcandidate);
+    }
+};
+
+/** Run a stake kernel scanning thread */
+void ThreadStakeKernelCheck();
+
+/** Wallet balances by category, computed together in one pass over mapWallet */
+struct CWalletBalances
+{
+    //! Available credit of trusted transactions, and the part of it delegated to cold stakers
+    CAmount nTrusted{0};
+    CAmount nTrustedDelegated{0};
+    //! Trusted P2CS coins for which we have the staking key, or the spending key
+    CAmount nColdStaking{0};
+    CAmount nDelegated{0};
+    //! Stakeable coins deep enough to stake, without and with the cold staking ones
+    CAmount nStaking{0};
+    CAmount nStakingCold{0};
+    CAmount nUnlocked{0};
+    CAmount nLocked{0};
+    CAmount nUnconfirmed{0};
+    CAmount nImmature{0};
+    CAmount nImmatureColdStaking{0};
+    CAmount nImmatureDelegated{0};
+    CAmount nWatchOnly{0};
+    CAmount nUnconfirmedWatchOnly{0};
+    CAmount nImmatureWatchOnly{0};
+    CAmount nLockedWatchOnly{0};
+
+    bool operator==(const CWalletBalances& b) const;
+    std::string ToString() const;
+};
+
+/**
+ * A lotto bet placed by a wallet transaction, and how it was settled.
+ * Stored in the wallet database under ("bet", outpoint).
+ */
+class CWalletBet
+{
+public:
+    enum Status {
+        BET_PENDING = 0, //!< the draw wasn't paid out yet
+        BET_LOST = 1,    //!< the draw was paid out without paying this bet
+        BET_PAID = 2,    //!< paid by the coinstake of hashSettleBlock
+        BET_UNKNOWN = 3, //!< the draw was paid out, but the payout address of the bet isn't known
+    };
+
+    COutPoint outpoint;
+    int64_t nOrderPos;
+    uint32_t nDate;
+    uint32_t nNumber1;
+    uint32_t nNumber2;
+    uint32_t nNumber3;
+    CAmount nBetValue;
+    //! Where a winning bet is paid to: the address of the bet transaction's first input
+    CScript scriptPayout;
+    int nStatus;
+    CAmount nPayout;
+    uint256 txidPayout;
+    //! The payout block that settled the bet
+    uint256 hashSettleBlock;
+
+    CWalletBet()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        outpoint.SetNull();
+        nOrderPos = -1;
+        nDate = nNumber1 = nNumber2 = nNumber3 = 0;
+        nBetValue = 0;
+        scriptPayout.clear();
+        SetPending();
+    }
+
+    void SetPending()
+    {
+        nStatus = BET_PENDING;
+        nPayout = 0;
+        txidPayout.SetNull();
+        hashSettleBlock.SetNull();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        int nVersion = s.GetVersion();
+        if (!(s.GetType() & SER_GETHASH))
+            READWRITE(nVersion);
+        READWRITE(outpoint);
+        READWRITE(nOrderPos);
+        READWRITE(nDate);
+        READWRITE(nNumber1);
+        READWRITE(nNumber2);
+        READWRITE(nNumber3);
+        READWRITE(nBetValue);
+        READWRITE(*(CScriptBase*)(&scriptPayout));
+        READWRITE(nStatus);
+        READWRITE(nPayout);
+        READWRITE(txidPayout);
+        READWRITE(hashSettleBlock);
+    }
+
+    std::string GetStatusString() const;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -253,8 +413,46 @@ private:
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
+    /* Outputs of wallet transactions that are ours and had no spender when added, ordered by value.
+     * AvailableCoins walks this instead of mapWallet. Spends remove outputs as they are added;
+     * anything that can make a spent output spendable again marks the set for a full rebuild. */
+    mutable std::set<std::pair<CAmount, COutPoint> > setWalletUTXO;
+    mutable bool fWalletUTXODirty;
+    void AddToWalletUTXO(const CWalletTx& wtx);
+    void RebuildWalletUTXO() const;
+
+    /* Balances of the last GetBalances call. They are valid until a wallet transaction changes
+     * (MarkBalancesDirty), which includes entering or leaving the mempool as every mempool
+     * change is notified through SyncTransaction, or the chain tip or the SwiftX locks change. */
+    mutable CWalletBalances cachedBalances;
+    mutable std::atomic<bool> fBalancesDirty;
+    mutable const CBlockIndex* pindexBalancesTip;
+    mutable int nBalancesTXLocks;
+    CWalletBalances ComputeBalances() const;
+
+    /* Lotto bets of wallet transactions, and the same bets in wallet order (order position
+     * of the placing transaction, then output) so that listbets pages through them directly. */
+    std::map<COutPoint, CWalletBet> mapWalletBets;
+    std::set<std::pair<int64_t, COutPoint> > setWalletBetsOrdered;
+    void AddWalletBets(const CWalletTx& wtx, CWalletDB* pwalletdb);
+    /* Settle the pending bets paid out by the coinstake of the payout block pindex. */
+    void SettleWalletBets(const CTransaction& txCoinStake, const CBlockIndex* pindex);
+
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /* Whether a transaction paying none of our outputs can still involve the wallet:
+     * it is already in the wallet, spends a wallet transaction or conflicts with one. */
+    bool IsRelatedToWallet(const CTransaction& tx) const;
+    /* Re-add the zPWRB mints of a rescanned block, and their spends, to the wallet (-zapwallettxes). */
+    void RescanZerocoinMints(const CBlock& block, const CBlockIndex* pindex, std::set<uint256>& setAddedToWallet);
+
+    /* Stakeable utxos kept between stake attempts. Only used by CreateCoinStake,
+     * cs_stakeCandidates is taken before cs_main and cs_wallet. */
+    RecursiveMutex cs_stakeCandidates;
+    std::map<COutPoint, CStakeCandidate> mapStakeCandidates;
+    void UpdateStakeCandidates(const std::vector<COutput>& vCoins);
+    void ScanStakeKernels(const CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTimeTx);
+
 public:
 
     static const CAmount DEFAULT_STAKE_SPLIT_THRESHOLD = 500 * COIN;
@@ -356,7 +554,7 @@ public:
                         ) const;
     //! >> Available coins (spending)
     bool SelectCoinsToSpend(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = nullptr, AvailableCoinsType coin_type = ALL_COINS, bool useIX = true, bool fIncludeColdStaking = false, bool fIncludeDelegated = true) const;
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     //! >> Available coins (staking)
     bool StakeableCoins(std::vector<COutput>* pCoins = nullptr);
     //! >> Available coins (P2CS)
@@ -441,6 +639,15 @@ public:
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
+    void BlockDisconnected(const CBlock& block, const CBlockIndex* pindex);
+
+    //! Adds a bet record to the wallet, without saving it to disk (used by LoadWallet)
+    void LoadWalletBet(const CWalletBet& bet);
+    /* Record the bets of wallet transactions that have none yet and settle the ones whose draw was
+     * paid out meanwhile (after loading the wallet, which may predate the bet records, or a rescan). */
+    void ReindexWalletBets();
+    /* Up to nCount bets, skipping the nFrom most recent ones, oldest to newest. */
+    std::vector<CWalletBet> ListWalletBets(int nCount, int nFrom) const;
 
     /**
      * Upgrade wallet to HD if needed. Does nothing if not.
@@ -451,7 +658,10 @@ public:
     void ReacceptWalletTransactions(bool fFirstLoad = false);
     void ResendWalletTransactions();
 
-    CAmount loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)>method) const;
+    /** All the balances below at once. Only recomputed after something they depend on changed. */
+    CWalletBalances GetBalances() const;
+    /** Called when a wallet transaction, or whether its outputs are spent or locked, changes */
+    void MarkBalancesDirty() const { fBalancesDirty = true; }
     CAmount GetBalance(bool fIncludeDelegated = true) const;
     CAmount GetColdStakingBalance() const;  // delegated coins for which we have the staking key
     CAmount GetImmatureColdStakingBalance() const;
@@ -511,6 +721,8 @@ public:
     bool IsChange(const CTxOut& txout) const;
     CAmount GetChange(const CTxOut& txout) const;
     bool IsMine(const CTransaction& tx) const;
+    /** The output scripts of our keys, redeem scripts and watch-only scripts, as matched against block filters */
+    void GetScriptPubKeys(std::set<CScript>& setScripts) const;
     /** should probably be renamed to IsRelevantToMe */
     bool IsFromMe(const CTransaction& tx) const;
     CAmount GetDebit(const CTransaction& tx, const isminefilter& filter) const;
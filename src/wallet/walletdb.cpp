@@ -69,6 +69,18 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WriteBet(const CWalletBet& bet)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("bet"), bet.outpoint), bet);
+}
+
+bool CWalletDB::EraseBet(const COutPoint& outpoint)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("bet"), outpoint));
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdated++;
@@ -488,6 +500,14 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 wss.fAnyUnordered = true;
 
             pwallet->AddToWallet(wtx, true, nullptr);
+        } else if (strType == "bet") {
+            COutPoint outpoint;
+            ssKey >> outpoint;
+            CWalletBet bet;
+            ssValue >> bet;
+            if (bet.outpoint != outpoint)
+                return false;
+            pwallet->LoadWalletBet(bet);
         } else if (strType == "acentry") {
             std::string strAccount;
             ssKey >> strAccount;
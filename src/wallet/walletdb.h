@@ -33,6 +33,7 @@ class CKeyPool;
 class CMasterKey;
 class CScript;
 class CWallet;
+class CWalletBet;
 class CWalletTx;
 class CDeterministicMint;
 class CZerocoinMint;
@@ -118,6 +119,9 @@ public:
     bool WriteTx(uint256 hash, const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    bool WriteBet(const CWalletBet& bet);
+    bool EraseBet(const COutPoint& outpoint);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata& keyMeta);
     bool WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey);
@@ -295,22 +295,16 @@ std::string ReindexZerocoinDB()
                     uint256 txid = tx.GetHash();
                     //Record Serials
                     if (tx.HasZerocoinSpendInputs()) {
-                        for (auto& in : tx.vin) {
-                            bool isPublicSpend = in.IsZerocoinPublicSpend();
-                            if (!in.IsZerocoinSpend() && !isPublicSpend)
+                        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                            const CTxIn& in = tx.vin[nIn];
+                            if (!in.IsZerocoinSpend() && !in.IsZerocoinPublicSpend())
                                 continue;
-                            if (isPublicSpend) {
-                                libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                                PublicCoinSpend publicSpend(params);
-                                CValidationState state;
-                                if (!ZPWRBModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                    return _("Failed to parse public spend");
-                                }
-                                vSpendInfo.push_back(std::make_pair(publicSpend, txid));
-                            } else {
-                                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                                vSpendInfo.push_back(std::make_pair(spend, txid));
+                            CValidationState state;
+                            CParsedZerocoinSpendRef pspend = ParseZerocoinSpend(tx, nIn, state);
+                            if (!pspend){
+                                return _("Failed to parse public spend");
                             }
+                            vSpendInfo.push_back(std::make_pair(*pspend->spend, txid));
                         }
                     }
 
@@ -362,6 +356,74 @@ libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin)
     return libzerocoin::CoinSpend(serializedCoinSpend);
 }
 
+bool CParsedZerocoinSpend::VerifyPublicSpend() const
+{
+    int nResult = nVerdict.load();
+    if (nResult < 0) {
+        // Same checks as ZPWRBModule::validateInput, on the already parsed spend
+        const PublicCoinSpend& publicSpend = static_cast<const PublicCoinSpend&>(*spend);
+        nResult = libzerocoin::ZerocoinDenominationToAmount(libzerocoin::IntToZerocoinDenomination(nSequence)) == prevOut.nValue &&
+                  publicSpend.Verify();
+        nVerdict.store(nResult);
+    }
+    return nResult == 1;
+}
+
+namespace
+{
+Mutex cs_parsedZerocoinSpends;
+//! Parsed spends by (txid, input index), and their keys with scriptSig sizes oldest first for eviction
+std::map<std::pair<uint256, unsigned int>, CParsedZerocoinSpendRef> mapParsedZerocoinSpends;
+std::deque<std::pair<std::pair<uint256, unsigned int>, size_t> > dequeParsedZerocoinSpends;
+size_t nParsedZerocoinSpendsSize = 0;
+} // anon namespace
+
+CParsedZerocoinSpendRef ParseZerocoinSpend(const CTransaction& tx, unsigned int nIn, CValidationState& state)
+{
+    const std::pair<uint256, unsigned int> key(tx.GetHash(), nIn);
+    {
+        LOCK(cs_parsedZerocoinSpends);
+        auto it = mapParsedZerocoinSpends.find(key);
+        if (it != mapParsedZerocoinSpends.end())
+            return it->second;
+    }
+
+    // Parse outside of the lock, a public spend looks its mint up under cs_main
+    const CTxIn& txin = tx.vin[nIn];
+    CParsedZerocoinSpendRef pspend;
+    if (txin.IsZerocoinPublicSpend()) {
+        CTxOut prevOut;
+        if (!GetOutput(txin.prevout.hash, txin.prevout.n, state, prevOut)) {
+            state.DoS(100, error("%s: public zerocoin spend prev output not found, prevTx %s, index %d",
+                                 __func__, txin.prevout.hash.GetHex(), txin.prevout.n));
+            return nullptr;
+        }
+        std::unique_ptr<PublicCoinSpend> publicSpend(new PublicCoinSpend(Params().GetConsensus().Zerocoin_Params(false)));
+        if (!ZPWRBModule::parseCoinSpend(txin, tx, prevOut, *publicSpend)) {
+            state.Invalid(error("%s: invalid public coin spend parse %s\n", __func__,
+                                tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-zpwrb");
+            return nullptr;
+        }
+        pspend = std::make_shared<const CParsedZerocoinSpend>(std::move(publicSpend), txin.nSequence, prevOut, true);
+    } else {
+        std::unique_ptr<const libzerocoin::CoinSpend> spend(new libzerocoin::CoinSpend(TxInToZerocoinSpend(txin)));
+        pspend = std::make_shared<const CParsedZerocoinSpend>(std::move(spend), txin.nSequence, CTxOut(), false);
+    }
+
+    LOCK(cs_parsedZerocoinSpends);
+    auto ret = mapParsedZerocoinSpends.emplace(key, pspend);
+    if (!ret.second)
+        return ret.first->second;
+    dequeParsedZerocoinSpends.emplace_back(key, txin.scriptSig.size());
+    nParsedZerocoinSpendsSize += txin.scriptSig.size();
+    while (nParsedZerocoinSpendsSize > MAX_PARSED_ZEROCOIN_SPENDS_SIZE) {
+        mapParsedZerocoinSpends.erase(dequeParsedZerocoinSpends.front().first);
+        nParsedZerocoinSpendsSize -= dequeParsedZerocoinSpends.front().second;
+        dequeParsedZerocoinSpends.pop_front();
+    }
+    return pspend;
+}
+
 bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state)
 {
     CBigNum publicZerocoin;
@@ -11,7 +11,10 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/CoinSpend.h"
+#include "primitives/transaction.h"
+#include <atomic>
 #include <list>
+#include <memory>
 #include <string>
 
 class CBlock;
@@ -41,6 +44,43 @@ libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid);
 
+/**
+ * A zerocoin spend input deserialized once and shared by every validation step that looks at it.
+ * Public spends are bound to the mint they spend and carry the verdict of their proof.
+ */
+class CParsedZerocoinSpend
+{
+private:
+    //! -1 until the proof of a public spend has been verified, then whether it verified
+    mutable std::atomic<int> nVerdict;
+
+public:
+    //! A PublicCoinSpend for public spends
+    std::unique_ptr<const libzerocoin::CoinSpend> spend;
+    //! nSequence of the spending input, which holds the claimed denomination
+    uint32_t nSequence;
+    //! The spent mint, public spends only
+    CTxOut prevOut;
+    bool fPublic;
+
+    CParsedZerocoinSpend(std::unique_ptr<const libzerocoin::CoinSpend> spendIn, uint32_t nSequenceIn, const CTxOut& prevOutIn, bool fPublicIn) :
+            nVerdict(-1), spend(std::move(spendIn)), nSequence(nSequenceIn), prevOut(prevOutIn), fPublic(fPublicIn) {}
+
+    /** Verify the proof of a public spend against its mint, once. Does not lock cs_main. */
+    bool VerifyPublicSpend() const;
+};
+typedef std::shared_ptr<const CParsedZerocoinSpend> CParsedZerocoinSpendRef;
+
+//! Serialized size of the parsed zerocoin spends kept, a few full blocks of public spends
+static const size_t MAX_PARSED_ZEROCOIN_SPENDS_SIZE = 8 << 20;
+
+/**
+ * The zerocoin spend in input nIn of tx, parsed on first use and then served from a cache keyed
+ * by (txid, nIn). Returns nullptr, with state set, if the prevout of a public spend is not found
+ * or does not parse. Throws like TxInToZerocoinSpend on malformed spends.
+ */
+CParsedZerocoinSpendRef ParseZerocoinSpend(const CTransaction& tx, unsigned int nIn, CValidationState& state);
+
 /** Global variable for the zerocoin supply */
 extern std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
 int64_t GetZerocoinSupply();
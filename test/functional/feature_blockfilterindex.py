@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The powerbalt developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test enabling -blockfilterindex on an existing chain.
+
+- Generate blocks without the index and check that getblockfilter is refused.
+- Restart with -blockfilterindex and wait for the filters of the existing
+  blocks to be built, then check that every block has a filter and that the
+  filter headers chain up from block 1.
+- Generate more blocks and check that they get a filter on connection.
+- Restart again and check that the index resumes synced.
+"""
+
+from test_framework.test_framework import PwrbTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+def filter_synced(node):
+    try:
+        node.getblockfilter(node.getbestblockhash())
+    except Exception:
+        return False
+    return True
+
+class BlockFilterIndexTest(PwrbTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def check_filters(self, node):
+        prev_header = None
+        for height in range(1, node.getblockcount() + 1):
+            result = node.getblockfilter(node.getblockhash(height))
+            assert result["filter"]
+            assert result["header"] != prev_header
+            prev_header = result["header"]
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.log.info("Generate blocks without the block filter index")
+        node.generate(50)
+        assert_raises_rpc_error(-1, "Block filters are disabled", node.getblockfilter, node.getbestblockhash())
+
+        self.log.info("Enable the index and wait for the existing blocks to be filtered")
+        self.restart_node(0, ["-blockfilterindex"])
+        node = self.nodes[0]
+        wait_until(lambda: filter_synced(node), timeout=60)
+        self.check_filters(node)
+
+        self.log.info("New blocks get a filter on connection")
+        node.generate(10)
+        self.check_filters(node)
+
+        self.log.info("The index resumes synced after a restart")
+        self.restart_node(0, ["-blockfilterindex"])
+        node = self.nodes[0]
+        wait_until(lambda: filter_synced(node), timeout=60)
+        assert_equal(node.getblockcount(), 60)
+        self.check_filters(node)
+
+if __name__ == '__main__':
+    BlockFilterIndexTest().main()
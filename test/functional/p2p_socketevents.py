@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The powerbalt developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test and time the -socketevents modes of the socket thread.
+
+- Check that an unknown -socketevents mode is rejected at startup.
+- For each mode supported on this platform (select, and epoll on Linux):
+    - Restart the node with it and connect --peers P2P connections.
+    - Assert that all of them completed the handshake.
+    - Ping all peers at once, wait for all the pongs and log how long the
+      round trip took. Repeat for --rounds rounds.
+    - Disconnect the peers again.
+
+The timings are only logged, run with a large --peers to compare the modes.
+"""
+
+import sys
+import time
+
+from test_framework.mininode import *
+from test_framework.test_framework import PwrbTestFramework
+from test_framework.util import *
+
+class SocketEventsTest(PwrbTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def add_options(self, parser):
+        parser.add_option("--peers", dest="peers", default=100, type="int",
+                          help="Number of P2P connections to open in each mode (default: %default)")
+        parser.add_option("--rounds", dest="rounds", default=10, type="int",
+                          help="Number of ping rounds to time in each mode (default: %default)")
+
+    def run_test(self):
+        self.log.info("Test that an unknown mode is rejected")
+        self.stop_node(0)
+        self.assert_start_raises_init_error(0, ["-socketevents=unknown"], "Invalid -socketevents mode: 'unknown'")
+
+        modes = ["select"]
+        if sys.platform.startswith("linux"):
+            modes.append("epoll")
+        for mode in modes:
+            self.run_mode(mode)
+
+    def run_mode(self, mode):
+        npeers = self.options.peers
+        self.log.info("Connect %d peers with -socketevents=%s" % (npeers, mode))
+        self.start_node(0, ["-socketevents=%s" % mode, "-maxconnections=%d" % (npeers + 16)])
+        peers = [self.nodes[0].add_p2p_connection(P2PInterface()) for _ in range(npeers)]
+        network_thread_start()
+        for peer in peers:
+            peer.wait_for_verack()
+        wait_until(lambda: self.nodes[0].getconnectioncount() == npeers, timeout=60)
+
+        elapsed = []
+        for nonce in range(1, self.options.rounds + 1):
+            start = time.time()
+            for peer in peers:
+                peer.send_message(msg_ping(nonce=nonce))
+            test_function = lambda: all(peer.last_message.get("pong") and peer.last_message["pong"].nonce == nonce for peer in peers)
+            wait_until(test_function, timeout=60, lock=mininode_lock)
+            elapsed.append(time.time() - start)
+        self.log.info("%s: %d ping rounds over %d peers, mean %.1fms, best %.1fms" %
+                      (mode, len(elapsed), npeers, 1000 * sum(elapsed) / len(elapsed), 1000 * min(elapsed)))
+
+        self.nodes[0].disconnect_p2ps()
+        network_thread_join()
+        self.stop_node(0)
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
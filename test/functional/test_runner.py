@@ -103,6 +103,7 @@ BASE_SCRIPTS= [
     'rpc_signrawtransaction.py',                # ~ 50 sec
     'rpc_decodescript.py',                      # ~ 50 sec
     'rpc_blockchain.py',                        # ~ 50 sec
+    'feature_blockfilterindex.py',              # ~ 50 sec
     'wallet_disable.py',                        # ~ 50 sec
     'feature_help.py',                          # ~ 30 sec
 
@@ -144,6 +145,7 @@ EXTENDED_SCRIPTS = [
     #'p2p_timeouts.py',
     # vv Tests less than 60s vv
     #'p2p_feefilter.py',
+    'p2p_socketevents.py',
     'rpc_bind.py',
     # vv Tests less than 30s vv
     #'example_test.py',